@@ -1,11 +1,14 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <queue>
 #include <utility>
 #include <vector>
 
 #include "array_operations.hpp"
 #include "common.hpp"
+#include "memory_utils.hpp"
 #include "select.hpp"
 
 namespace mcts {
@@ -21,7 +24,8 @@ template<class Environment>
 struct UpdateMethod<Environment, SampleAverage> {
   typedef ActionInfoBase<Environment> ActionInfo;
 
-  void operator()(ActionInfo& action_info, const Reward<Environment>& target) const {
+  template<class ActionInfoRef>
+  void operator()(ActionInfoRef&& action_info, const Reward<Environment>& target) const {
     double step = 1.0 / action_info.visits;
     action_info.expected_return += step*(target - action_info.expected_return);
   }
@@ -59,7 +63,8 @@ struct UpdateMethod<Environment, ExponentialAverage> {
 
   UpdateMethod(double step = 0.1) : step(step) {}
 
-  void operator()(ActionInfo& action_info, const Reward<Environment>& target) const {
+  template<class ActionInfoRef>
+  void operator()(ActionInfoRef&& action_info, const Reward<Environment>& target) const {
     action_info.expected_return += step*(target - action_info.expected_return);
   }
 };
@@ -79,21 +84,19 @@ struct StandardBackup {
     discount(discount), update(std::forward<Args>(args)...) {
   }
 
-  template<class Memory>
+  template<class Handle>
   void operator()(
-      Memory& memory,
-      const TreePath<Environment>& tree_path,
+      const TreePath<Handle>& tree_path,
       const RewardVector<Environment>& rewards) const {
     Reward<Environment> acc_reward{0};
     for (int i = rewards.size()-1; i >= tree_path.size(); --i)
       acc_reward = rewards[i] + discount*acc_reward;
     for (int i = tree_path.size()-1; i >= 0; --i) {
-      const auto&[state, action_index] = tree_path[i];
-      auto& node = memory.find(state)->second;
-      auto& action_info = node.action_vector[action_index];
+      acc_reward = rewards[i] + discount*acc_reward;
+      auto& node = tree_path[i].node();
+      auto&& action_info = node.action_vector[tree_path[i].action_index];
       ++node.visits;
       ++action_info.visits;
-      acc_reward = rewards[i] + discount*acc_reward;
       update(action_info, acc_reward);
     }
   }
@@ -115,18 +118,16 @@ struct SarsaBackup {
     discount(discount), update(std::forward<Args>(args)...) {
   }
 
-  template<class Memory>
+  template<class Handle>
   void operator()(
-      Memory& memory,
-      const TreePath<Environment>& tree_path,
+      const TreePath<Handle>& tree_path,
       const RewardVector<Environment>& rewards) const {
     Reward<Environment> td_target{0};
     for (int i = rewards.size()-1; i >= tree_path.size(); --i)
       td_target = rewards[i] + discount*td_target;
     for (int i = tree_path.size()-1; i >= 0; --i) {
-      const auto&[state, action_index] = tree_path[i];
-      auto& node = memory.find(state)->second;
-      auto& action_info = node.action_vector[action_index];
+      auto& node = tree_path[i].node();
+      auto&& action_info = node.action_vector[tree_path[i].action_index];
       ++node.visits;
       ++action_info.visits;
       update(action_info, rewards[i] + discount*td_target);
@@ -150,19 +151,17 @@ struct QlearnBackup {
     discount(discount), update(std::forward<Args>(args)...) {
   }
 
-  template<class Memory>
+  template<class Handle>
   void operator()(
-      Memory& memory,
-      const TreePath<Environment>& tree_path,
+      const TreePath<Handle>& tree_path,
       const RewardVector<Environment>& rewards) const {
     GreedySelect greedy_select;
     Reward<Environment> td_target{0};
     for (int i = rewards.size()-1; i >= tree_path.size(); --i)
       td_target = rewards[i] + discount*td_target;
     for (int i = tree_path.size()-1; i >= 0; --i) {
-      const auto&[state, action_index] = tree_path[i];
-      auto& node = memory.find(state)->second;
-      auto& action_info = node.action_vector[action_index];
+      auto& node = tree_path[i].node();
+      auto&& action_info = node.action_vector[tree_path[i].action_index];
       ++node.visits;
       ++action_info.visits;
       update(action_info, rewards[i] + discount*td_target);
@@ -172,5 +171,171 @@ struct QlearnBackup {
   }
 };
 
+/*
+ * StandardBackup that also keeps all-moves-as-first (AMAF) statistics: every
+ * node of the path updates the AMAF return of each of its actions that its
+ * player took later in the episode (in the tree or in the rollout, the
+ * first time only) with the return of the node. RaveSelect blends them with
+ * the values of the actions. Mcts passes the played actions to the backups
+ * that take them; without them (as in the tree-parallel searches) only the
+ * standard statistics are updated. Not valid for SoaNodes.
+ */
+template<class Environment, class Tag>
+struct RaveBackup {
+  typedef UpdateMethod<Environment,Tag> UpdateMethodType;
+
+  struct ActionInfo : UpdateMethodType::ActionInfo {
+    Reward<Environment> amaf_return;
+    int amaf_visits;
+  };
+
+  typedef NodeBase<ActionInfo> Node;
+
+  double discount;
+  UpdateMethodType update;
+
+  RaveBackup(double discount = 1) : discount(discount) {}
+
+  template<class... Args>
+  RaveBackup(double discount, Args&&... args) :
+    discount(discount), update(std::forward<Args>(args)...) {
+  }
+
+  template<class Handle>
+  void operator()(
+      const TreePath<Handle>& tree_path,
+      const RewardVector<Environment>& rewards) const {
+    (*this)(tree_path, rewards, PlayedActions<Environment>());
+  }
+
+  /*
+   * played holds the actions of the whole episode, from the root. Walking
+   * up from the leaf, the distinct (player, action) pairs played from the
+   * current ply on grow in a hash set, which is exactly what counts for
+   * the AMAF values of the node at that ply, so every node only looks up
+   * each of its actions once.
+   */
+  template<class Handle>
+  void operator()(
+      const TreePath<Handle>& tree_path,
+      const RewardVector<Environment>& rewards,
+      const PlayedActions<Environment>& played) const {
+    // reused by the backups of the thread, so they do not allocate
+    static thread_local PlayedActionSet later_actions;
+    later_actions.reset(played.size());
+    for (int i = played.size()-1; i >= int(tree_path.size()); --i)
+      later_actions.insert(played[i]);
+    Reward<Environment> acc_reward{0};
+    for (int i = rewards.size()-1; i >= tree_path.size(); --i)
+      acc_reward = rewards[i] + discount*acc_reward;
+    for (int i = tree_path.size()-1; i >= 0; --i) {
+      acc_reward = rewards[i] + discount*acc_reward;
+      auto& node = tree_path[i].node();
+      auto&& action_info = node.action_vector[tree_path[i].action_index];
+      ++node.visits;
+      ++action_info.visits;
+      update(action_info, acc_reward);
+      if (i >= int(played.size()))
+        continue;
+      later_actions.insert(played[i]);
+      for (unsigned k = 0; k < node.action_vector.size(); ++k) {
+        auto&& amaf_info = node.action_vector[k];
+        if (!later_actions.contains({amaf_info.action, node.maximizing_player}))
+          continue;
+        ++amaf_info.amaf_visits;
+        amaf_info.amaf_return += (1.0/amaf_info.amaf_visits)*(acc_reward - amaf_info.amaf_return);
+      }
+    }
+  }
+
+  private:
+    // Open addressing set of played actions, with linear probing
+    class PlayedActionSet {
+      public:
+        // Empties the set, with room for size actions at load <= 0.5
+        void reset(std::size_t size) {
+          std::size_t capacity = 16;
+          while (capacity < 2*size)
+            capacity *= 2;
+          m_slots.resize(capacity);
+          m_used.assign(capacity, false);
+          m_mask = capacity - 1;
+        }
+
+        void insert(const PlayedAction<Environment>& played) {
+          std::size_t slot = find(played);
+          m_slots[slot] = played;
+          m_used[slot] = true;
+        }
+
+        bool contains(const PlayedAction<Environment>& played) const {
+          return m_used[find(played)];
+        }
+
+      private:
+        // Slot of played, or the empty slot where it would go
+        std::size_t find(const PlayedAction<Environment>& played) const {
+          std::uint64_t hash = ActionHash<Action<Environment>>()(played.action) ^
+                               (played.player + 1)*0x9E3779B97F4A7C15ULL;
+          std::size_t slot = (hash*0x9E3779B97F4A7C15ULL) >> 32 & m_mask;
+          while (m_used[slot] && !(m_slots[slot].player == played.player &&
+                                   m_slots[slot].action == played.action))
+            slot = (slot + 1) & m_mask;
+          return slot;
+        }
+
+        std::vector<PlayedAction<Environment>> m_slots;
+        std::vector<char> m_used;
+        std::size_t m_mask;
+    };
+};
+
+/*
+ * Backup adaptor that makes the search keep the action statistics of each
+ * node in an arena owned by the search instead of in a std::vector, so
+ * expansions do not hit the general purpose allocator.
+ */
+template<class Backup>
+struct ArenaNodes : Backup {
+  typedef typename Backup::Node::ActionInfoType ActionInfo;
+  typedef NodeBase<ActionInfo, memory::ArenaArray<ActionInfo>> Node;
+
+  using Backup::Backup;
+};
+
+/*
+ * Backup adaptor that keeps the action statistics of each node as a struct
+ * of arrays (see SoaActionStorage), which the selectors scan with SIMD
+ * kernels. Only valid for update methods based on ActionInfoBase.
+ */
+template<class Backup>
+struct SoaNodes : Backup {
+  typedef typename Backup::Node::ActionInfoType ActionInfo;
+  typedef NodeBase<ActionInfo, SoaActionStorage<ActionInfo>> Node;
+
+  using Backup::Backup;
+};
+
+/*
+ * Backup adaptor for progressive widening: the nodes only hold the actions
+ * that their visits allow (see WideningNode), which saves memory and
+ * selection time on wide nodes whose actions mostly get a single visit.
+ * Only for Mcts: TreeParallelMcts cannot init the nodes and
+ * RootParallelMcts rejects them, since it merges full root nodes.
+ */
+template<class Backup>
+struct WideningNodes : Backup {
+  typedef typename Backup::Node::ActionInfoType ActionInfo;
+  typedef WideningNode<ActionInfo> Node;
+
+  Widening widening;
+
+  WideningNodes(Widening widening = Widening()) : widening(widening) {}
+
+  template<class... Args>
+  WideningNodes(Widening widening, Args&&... args) :
+    Backup(std::forward<Args>(args)...), widening(widening) {
+  }
+};
 
 } // mcts
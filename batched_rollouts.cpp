@@ -0,0 +1,253 @@
+#include <cmath>
+
+#include "batched_rollouts.hpp"
+#include "simd_select.hpp"
+#include "tictactoe_utils.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MCTS_SIMD_X86
+#endif
+
+namespace ultimate_tictactoe {
+
+namespace {
+
+constexpr int LANES = BatchedRollouts::LANES;
+constexpr std::uint32_t FULL_MASK = 0x1FF;
+constexpr std::uint32_t LINES[8] = {0x007, 0x038, 0x1C0, 0x049, 0x092, 0x124, 0x111, 0x054};
+
+// Outcome of the game of a lane
+constexpr std::uint32_t ONGOING = 0, X_WINS = 1, O_WINS = 2, TIE = 3;
+
+/*
+ * The lanes are played in groups of one vector register, with GCC vector
+ * extensions: the operations are element wise and map to single
+ * instructions. Wider vectors than the target registers get their
+ * comparisons split into scalar code, so the AVX2 kernel plays groups of 8
+ * lanes and the portable one (SSE2 or NEON) groups of 4. Comparisons give
+ * masks (all bits set where true) and the lanes are blended with them,
+ * since the conditional operator on vectors is split into scalar code too.
+ */
+typedef std::uint32_t Vector4 __attribute__((vector_size(16)));
+typedef std::int32_t SignedVector4 __attribute__((vector_size(16)));
+typedef std::uint32_t Vector8 __attribute__((vector_size(32)));
+typedef std::int32_t SignedVector8 __attribute__((vector_size(32)));
+
+// Position of the leaf, shared by all the lanes
+struct Start {
+  std::uint32_t x[9], o[9];
+  std::uint32_t playable, x_won, o_won, player;
+  std::int32_t active;
+};
+
+/*
+ * The games of a group of lanes: the x and o cells of every subboard, the
+ * 9-bit masks with one bit per subboard, the active subboard (-1 for any),
+ * the player to move and the steps played.
+ */
+template<class Vector, class SignedVector>
+struct Lanes {
+  static constexpr int width = sizeof(Vector)/sizeof(std::uint32_t);
+
+  Vector x[9], o[9];
+  Vector playable, x_won, o_won;
+  SignedVector active;
+  Vector player, steps, outcome, rng;
+};
+
+/*
+ * Bit counting and line detection without lookup tables, so they vectorize.
+ * The vectors go by reference: passing them by value depends on the
+ * vector extensions of the target.
+ */
+template<class Vector>
+__attribute__((always_inline)) inline
+void popcount9(const Vector& mask, Vector& count) {
+  count = mask - ((mask >> 1) & 0x55555555);
+  count = (count & 0x33333333) + ((count >> 2) & 0x33333333);
+  count = (count + (count >> 4)) & 0x0F0F0F0F;
+  count = (count & 0xFF) + (count >> 8);
+}
+
+template<class Vector>
+__attribute__((always_inline)) inline
+void has_line(const Vector& mask, Vector& line) {
+  line = Vector{};
+  for (std::uint32_t cells : LINES)
+    line |= Vector((mask & cells) == cells);
+}
+
+// Plays all the lanes until every game is over. Every step goes through
+// all the subboards of all the lanes, with the finished lanes masked out.
+template<class Vector, class SignedVector>
+__attribute__((always_inline)) inline
+void play(Lanes<Vector,SignedVector>& lanes) {
+  while (true) {
+    Vector live = Vector(lanes.outcome == ONGOING);
+    std::uint32_t any_live = 0;
+    for (int l = 0; l < lanes.width; ++l)
+      any_live |= live[l];
+    if (!any_live)
+      break;
+    Vector free[9], count[9], total = {};
+    Vector any_subboard = Vector(lanes.active == -1);
+    for (int s = 0; s < 9; ++s) {
+      Vector allowed = live & Vector(((lanes.playable >> s) & 1) != 0) &
+          (any_subboard | Vector(lanes.active == s));
+      free[s] = ~(lanes.x[s] | lanes.o[s]) & FULL_MASK & allowed;
+      popcount9(free[s], count[s]);
+      total += count[s];
+    }
+    // uniform rank among all the available actions, as RandomPolicy picks
+    Vector r = lanes.rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    lanes.rng = r;
+    SignedVector rank = SignedVector(((r >> 16)*total) >> 16);
+    SignedVector subboard = {}, cell_rank = {};
+    Vector picked = {};
+    for (int s = 0; s < 9; ++s) {
+      SignedVector take = (rank >= 0) & (rank < SignedVector(count[s]));
+      subboard = (take & s) | (~take & subboard);
+      cell_rank = (take & rank) | (~take & cell_rank);
+      picked = (Vector(take) & free[s]) | (~Vector(take) & picked);
+      rank -= SignedVector(count[s]);
+    }
+    SignedVector cell = {};
+    for (int b = 0; b < 9; ++b) {
+      SignedVector bit = SignedVector((picked >> b) & 1);
+      SignedVector take = (bit != 0) & (cell_rank == 0);
+      cell = (take & b) | (~take & cell);
+      cell_rank -= bit;
+    }
+    Vector o_turn = Vector(lanes.player != 0);
+    Vector move = (Vector{} + 1U) << Vector(cell);
+    Vector mover = {}, occupied = {};
+    for (int s = 0; s < 9; ++s) {
+      Vector on = live & Vector(subboard == s);
+      lanes.x[s] |= move & on & ~o_turn;
+      lanes.o[s] |= move & on & o_turn;
+      mover |= on & ((o_turn & lanes.o[s]) | (~o_turn & lanes.x[s]));
+      occupied |= on & (lanes.x[s] | lanes.o[s]);
+    }
+    // only the player that has just moved can have completed a line
+    Vector won;
+    has_line(mover, won);
+    won &= live;
+    Vector closed = won | (live & Vector(occupied == FULL_MASK));
+    Vector subboard_bit = (Vector{} + 1U) << Vector(subboard);
+    lanes.playable &= ~(closed & subboard_bit);
+    lanes.x_won |= won & ~o_turn & subboard_bit;
+    lanes.o_won |= won & o_turn & subboard_bit;
+    Vector x_line, o_line;
+    has_line(lanes.x_won, x_line);
+    has_line(lanes.o_won, o_line);
+    Vector no_moves = Vector(lanes.playable == 0);
+    Vector x_count, o_count;
+    popcount9(lanes.x_won, x_count);
+    popcount9(lanes.o_won, o_count);
+    Vector x_wins = x_line | (no_moves & ~o_line & Vector(x_count > o_count));
+    Vector o_wins = o_line | (no_moves & ~x_line & Vector(o_count > x_count));
+    Vector tie = no_moves & ~x_wins & ~o_wins;
+    Vector outcome = (x_wins & X_WINS) | (o_wins & O_WINS) | (tie & TIE);
+    lanes.outcome = (live & outcome) | (~live & lanes.outcome);
+    SignedVector playable_next = SignedVector(((lanes.playable >> Vector(cell)) & 1) != 0);
+    SignedVector next = (playable_next & cell) | ~playable_next;
+    lanes.active = (SignedVector(live) & next) | (~SignedVector(live) & lanes.active);
+    lanes.player ^= live & 1;
+    lanes.steps += live & 1;
+  }
+}
+
+/*
+ * Plays the lanes from first to first + width and adds their discounted
+ * returns to sum
+ */
+template<class Vector, class SignedVector>
+__attribute__((always_inline)) inline
+void play_group(
+    const Start& start,
+    double discount,
+    std::uint32_t* rng,
+    Reward& sum) {
+  Lanes<Vector,SignedVector> lanes;
+  for (int s = 0; s < 9; ++s) {
+    lanes.x[s] = Vector{} + start.x[s];
+    lanes.o[s] = Vector{} + start.o[s];
+  }
+  lanes.playable = Vector{} + start.playable;
+  lanes.x_won = Vector{} + start.x_won;
+  lanes.o_won = Vector{} + start.o_won;
+  lanes.active = SignedVector{} + start.active;
+  lanes.player = Vector{} + start.player;
+  lanes.steps = Vector{};
+  lanes.outcome = Vector{} + ONGOING;
+  for (int l = 0; l < lanes.width; ++l)
+    lanes.rng[l] = rng[l];
+  play(lanes);
+  for (int l = 0; l < lanes.width; ++l) {
+    rng[l] = lanes.rng[l];
+    // the only reward of a game is its score, at the last step
+    double factor = std::pow(discount, int(lanes.steps[l]) - 1);
+    sum[0] += factor*(lanes.outcome[l] == X_WINS? 1 : lanes.outcome[l] == TIE? 0.5 : 0);
+    sum[1] += factor*(lanes.outcome[l] == O_WINS? 1 : lanes.outcome[l] == TIE? 0.5 : 0);
+  }
+}
+
+#ifdef MCTS_SIMD_X86
+__attribute__((target("avx2")))
+void play_avx2(const Start& start, double discount, std::uint32_t* rng, Reward& sum) {
+  static_assert(LANES % 8 == 0);
+  for (int first = 0; first < LANES; first += 8)
+    play_group<Vector8,SignedVector8>(start, discount, rng + first, sum);
+}
+#endif
+
+void play_portable(const Start& start, double discount, std::uint32_t* rng, Reward& sum) {
+  static_assert(LANES % 4 == 0);
+  for (int first = 0; first < LANES; first += 4)
+    play_group<Vector4,SignedVector4>(start, discount, rng + first, sum);
+}
+
+} // anonymous ns
+
+BatchedRollouts::BatchedRollouts(std::uint64_t seed) {
+  for (int l = 0; l < LANES; ++l) {
+    // splitmix64 of the seed and the lane
+    std::uint64_t z = seed + (l + 1)*0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    m_rng[l] = std::uint32_t(z)? std::uint32_t(z) : 1;
+  }
+}
+
+Reward BatchedRollouts::evaluate(const Environment& leaf, double discount) {
+  if (leaf.is_terminal())
+    return Reward{};
+  using tictactoe::LU_TABLE;
+  Start start;
+  start.playable = start.x_won = start.o_won = 0;
+  for (int s = 0; s < 9; ++s) {
+    std::uint32_t x = leaf.get_state().subboards[s] & FULL_MASK;
+    std::uint32_t o = leaf.get_state().subboards[s] >> 9;
+    start.x[s] = x;
+    start.o[s] = o;
+    start.x_won |= LU_TABLE[x] << s;
+    start.o_won |= LU_TABLE[o] << s;
+    start.playable |= (!LU_TABLE[x] && !LU_TABLE[o] && (x | o) != FULL_MASK) << s;
+  }
+  start.active = leaf.get_state().active_subboard;
+  start.player = leaf.get_current_player();
+  Reward sum{};
+#ifdef MCTS_SIMD_X86
+  if (mcts::simd::avx2_enabled())
+    play_avx2(start, discount, m_rng.data(), sum);
+  else
+#endif
+    play_portable(start, discount, m_rng.data(), sum);
+  return {sum[0]/LANES, sum[1]/LANES};
+}
+
+} // ultimate_tictactoe
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "ultimate_tictactoe.hpp"
+
+namespace ultimate_tictactoe {
+
+/*
+ * Leaf evaluator that plays LANES uniformly random games from the leaf in
+ * lockstep and returns their mean discounted return. The games are kept as
+ * struct of arrays (one vector element per lane of every subboard, mask
+ * and counter) and every step is branch free across the lanes, from the
+ * random choice of the move to the detection of the result. An AVX2 kernel
+ * (groups of 8 lanes) is used when the CPU supports it, with a portable one
+ * (groups of 4) otherwise. The lanes draw their moves from xorshift32
+ * generators, so their games differ from those of RandomPolicy, but they
+ * follow the same distribution.
+ */
+class BatchedRollouts {
+  public:
+    static constexpr int LANES = 16;
+
+    explicit BatchedRollouts(std::uint64_t seed = 0);
+
+    Reward evaluate(const Environment& leaf, double discount);
+
+    unsigned rollouts_per_leaf() const {
+      return LANES;
+    }
+
+  private:
+    // xorshift32 state of every lane (never zero)
+    std::array<std::uint32_t,LANES> m_rng;
+};
+
+} // ultimate_tictactoe
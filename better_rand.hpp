@@ -101,6 +101,28 @@ class pcg32 {
       result_type rot = old_state >> 59;
       return (xorshifted>>rot) | (xorshifted<<((-rot)&31));
     }
+
+    /* Skips delta outputs in O(log delta) steps (Brown, "Random number
+       generation with arbitrary strides") */
+    void advance(state_type delta) {
+      state_type acc_mul = 1, acc_inc = 0, cur_mul = mul, cur_inc = inc;
+      for (; delta; delta >>= 1) {
+        if (delta & 1) {
+          acc_mul *= cur_mul;
+          acc_inc = acc_inc*cur_mul + cur_inc;
+        }
+        cur_inc = (cur_mul + 1)*cur_inc;
+        cur_mul *= cur_mul;
+      }
+      m_state = acc_mul*m_state + acc_inc;
+    }
+
+    /* Splits the period in 2^16 streams of 2^48 outputs */
+    static constexpr state_type stream_length = state_type(1) << 48;
+
+    void jump() {
+      advance(stream_length);
+    }
   private:
     state_type m_state;
 };
@@ -149,6 +171,39 @@ class xoshiro256ss {
     	return result;
     }
 
+    /* Equivalent to 2^128 calls: splits the period in 2^128 streams */
+    void jump() {
+      static constexpr result_type JUMP[] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+      };
+      jump(JUMP);
+    }
+
+    /* Equivalent to 2^192 calls: 2^64 starting points of jump() streams */
+    void long_jump() {
+      static constexpr result_type LONG_JUMP[] = {
+        0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+        0x77710069854ee241ULL, 0x39109bb02acbe635ULL
+      };
+      jump(LONG_JUMP);
+    }
+
   private:
+    void jump(const result_type (&polynomial)[4]) {
+      result_type s[4] = {0, 0, 0, 0};
+      for (result_type word : polynomial) {
+        for (unsigned b = 0; b < 64; ++b) {
+          if (word & (result_type(1) << b)) {
+            for (unsigned i = 0; i < 4; ++i)
+              s[i] ^= m_s[i];
+          }
+          (*this)();
+        }
+      }
+      for (unsigned i = 0; i < 4; ++i)
+        m_s[i] = s[i];
+    }
+
     result_type m_s[4];
 };
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cstdlib>
+
 #include "utils.hpp"
 
 #include "bidding_game.hpp"
@@ -5,16 +8,45 @@
 
 namespace bidding_game{
 
+namespace {
+
+constexpr int INITIAL_BUDGET = 100;
+
+// One key per budget value of each player, per scotch position and per flag
+constexpr auto BUDGET_KEYS = mcts::make_zobrist_keys<2*(INITIAL_BUDGET+1)>(0xb1d0);
+constexpr auto SCOTCH_KEYS = mcts::make_zobrist_keys<11>(0x5c07c4);
+constexpr auto FLAG_KEYS = mcts::make_zobrist_keys<2>(0xf1a6);
+
+std::uint64_t budget_key(int player, int budget) {
+  return BUDGET_KEYS[player*(INITIAL_BUDGET+1) + budget];
+}
+
+} // anonymous ns
+
 Environment::Environment() {
   reset();
 }
 
 std::vector<Action> Environment::get_available_actions() const {
-  std::vector<Action> available_actions;
-  available_actions.reserve(m_state.budget[m_state.current_player]);
+  ActionBuffer available_actions;
+  get_available_actions(available_actions);
+  return {available_actions.begin(), available_actions.end()};
+}
+
+void Environment::get_available_actions(ActionBuffer& actions) const {
   for (int i = 1; i <= m_state.budget[m_state.current_player]; ++i)
-    available_actions.push_back(i);
-  return available_actions;
+    actions.push_back(i);
+}
+
+void Environment::order_actions(ActionBuffer& actions) const {
+  int player = m_state.current_player;
+  int bids_to_win = player == 0? m_state.scotch : 10 - m_state.scotch;
+  int even_bid = std::max(1, m_state.budget[player]/bids_to_win);
+  // the lower bid first among equally distant ones
+  std::sort(actions.begin(), actions.end(), [even_bid](Action lhs, Action rhs) {
+    int lhs_distance = std::abs(lhs - even_bid), rhs_distance = std::abs(rhs - even_bid);
+    return lhs_distance < rhs_distance || (lhs_distance == rhs_distance && lhs < rhs);
+  });
 }
 
 bool Environment::is_terminal() const {
@@ -30,6 +62,8 @@ const Reward& Environment::step(Action action, bool check) {
   if (m_state.current_player == 0)
     m_action_0 = action; // hold the bet until next player's turn
   else {
+    std::uint64_t key = m_state.key ^ SCOTCH_KEYS[m_state.scotch] ^
+      budget_key(0, m_state.budget[0]) ^ budget_key(1, m_state.budget[1]);
     if (m_action_0 < action) {
       m_state.scotch++;
       m_state.budget[1] -= action;
@@ -42,20 +76,26 @@ const Reward& Environment::step(Action action, bool check) {
       m_state.scotch += m_state.draw_advantage - !m_state.draw_advantage;
       m_state.budget[m_state.draw_advantage] -= action;
       m_state.draw_advantage = !m_state.draw_advantage;
+      key ^= FLAG_KEYS[0];
     }
+    m_state.key = key ^ SCOTCH_KEYS[m_state.scotch] ^
+      budget_key(0, m_state.budget[0]) ^ budget_key(1, m_state.budget[1]);
     m_turn += 1;
     update_score();
   }
   m_state.current_player = !m_state.current_player;
+  m_state.key ^= FLAG_KEYS[1];
   return m_score;
 }
 
 void Environment::reset() {
   m_score.fill(0);
-  m_state.budget.fill(100);
+  m_state.budget.fill(INITIAL_BUDGET);
   m_state.scotch = 5;
   m_state.draw_advantage = 0;
   m_state.current_player = 0;
+  m_state.key = SCOTCH_KEYS[m_state.scotch] ^
+    budget_key(0, m_state.budget[0]) ^ budget_key(1, m_state.budget[1]);
   m_turn = 0;
 }
 
@@ -101,12 +141,6 @@ std::ostream& operator<<(std::ostream& out, const State& state) {
 } // bidding_game
 
 size_t std::hash<bidding_game::State>::operator()(const State& state) const {
-  size_t seed = 0;
-  mcts::hash_combine(seed, state.budget[0]);
-  mcts::hash_combine(seed, state.budget[1]);
-  mcts::hash_combine(seed, state.scotch);
-  mcts::hash_combine(seed, state.draw_advantage);
-  mcts::hash_combine(seed, state.current_player);
-  return seed;
+  return state.key;
 }
 
@@ -2,10 +2,13 @@
 
 #include <array>
 #include <bitset>
+#include <cstdint>
 #include <functional>
 #include <ostream>
 #include <vector>
 
+#include "utils.hpp"
+
 namespace bidding_game {
 
 class Environment {
@@ -18,10 +21,16 @@ class Environment {
     struct State {
       std::array<int,2> budget;
       int scotch, draw_advantage, current_player;
+      // Zobrist key of the fields above, kept up to date by step()
+      std::uint64_t key;
     };
 
     typedef int Action;
 
+    static constexpr int max_number_of_actions = 100;
+
+    typedef mcts::StaticVector<Action,max_number_of_actions> ActionBuffer;
+
     Environment();
 
     int get_turn() const { return m_turn; }
@@ -30,6 +39,12 @@ class Environment {
 
     std::vector<Action> get_available_actions() const;
 
+    void get_available_actions(ActionBuffer& actions) const;
+
+    // Bids closest to an even split of the budget over the bids still to
+    // win first (see order_available_actions)
+    void order_actions(ActionBuffer& actions) const;
+
     int get_number_of_players() const { return number_of_players; }
 
     int get_current_player() const { return m_state.current_player; }
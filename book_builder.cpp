@@ -0,0 +1,59 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "better_rand.hpp"
+#include "mcts.hpp"
+#include "opening_book.hpp"
+#include "thread_pool.hpp"
+#include "ultimate_tictactoe.hpp"
+using namespace std;
+using namespace mcts;
+
+using ultimate_tictactoe::Environment;
+
+unique_ptr<MctsBase<Environment>> standard_mcts() {
+  auto rng = make_shared<pcg32>();
+  rng->random_seed();
+  return create_algorithm<Environment>(
+      UctSelect(0.5), RandomPolicy(rng), StandardBackup<Environment,SampleAverage>());
+}
+
+// book_builder.x [book_file] [depth] [simulations]
+int main(int argc, char* argv[]) {
+  using namespace chrono;
+  string path = argc > 1? argv[1] : "ultimate_tictactoe.book";
+  OpeningBookOptions options;
+  if (argc > 2)
+    options.depth = stoi(argv[2]);
+  if (argc > 3)
+    options.simulations = stoi(argv[3]);
+
+  multithreading::Pool pool;
+  auto start = steady_clock::now();
+  OpeningBook<Environment>::build(path, pool, standard_mcts, options, &cerr);
+  duration<double> build_time = steady_clock::now() - start;
+
+  auto book = make_shared<const OpeningBook<Environment>>(path);
+  cout << "Opening book " << path << " (depth " << options.depth << ", "
+       << options.simulations << " simulations per position)\n"
+       << "positions: " << book->size() << ", bytes: " << book->bytes() << '\n'
+       << fixed << setprecision(1)
+       << "build: " << build_time.count() << "s on " << pool.number_of_workers() << " workers\n";
+
+  // a self-play game that leaves the book once it runs out of positions
+  BookSearch<Environment> player(book, standard_mcts());
+  Environment env;
+  double book_time = 0;
+  while (!env.is_terminal()) {
+    int book_moves = player.book_moves();
+    env.step(player.search(env, nullptr, -1, 1000));
+    if (player.book_moves() > book_moves)
+      book_time += player.get_statistics().elapsed_last_call;
+  }
+  cout << "book moves in a self-play game: " << player.book_moves()
+       << " (" << setprecision(2) << 1e6*book_time/max(player.book_moves(), 1)
+       << "us per move)" << endl;
+}
@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <ostream>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -15,11 +21,21 @@ using Action = typename Environment::Action;
 template<class Environment>
 using Reward = typename Environment::Reward;
 
-template<class Environment>
-using StateIntPair = std::pair<State<Environment>,int>;
+/*
+ * Ply of a simulation inside the tree: a handle to the node (an iterator of
+ * the search memory, pinned while the simulation runs so that it stays
+ * valid) and the index of the action selected in it.
+ */
+template<class Handle>
+struct PathStep {
+  Handle handle;
+  int action_index;
 
-template<class Environment>
-using TreePath = std::vector<StateIntPair<Environment>>;
+  auto& node() const { return handle->second; }
+};
+
+template<class Handle>
+using TreePath = std::vector<PathStep<Handle>>;
 
 template<class Environment>
 using ActionVector = std::vector<Action<Environment>>;
@@ -27,6 +43,128 @@ using ActionVector = std::vector<Action<Environment>>;
 template<class Environment>
 using RewardVector = std::vector<Reward<Environment>>;
 
+// Action of an episode and the player that took it
+template<class Environment>
+struct PlayedAction {
+  Action<Environment> action;
+  int player;
+};
+
+template<class Environment>
+using PlayedActions = std::vector<PlayedAction<Environment>>;
+
+/*
+ * Environments may additionally provide an ActionBuffer type (usually a
+ * StaticVector) and a get_available_actions(ActionBuffer&) overload that
+ * fills it without allocating. ActionList is the buffer when available and
+ * a plain ActionVector otherwise.
+ */
+template<class Environment, class = void>
+struct HasActionBuffer : std::false_type {};
+
+template<class Environment>
+struct HasActionBuffer<Environment, std::void_t<
+  decltype(std::declval<const Environment&>().get_available_actions(
+        std::declval<typename Environment::ActionBuffer&>()))>> : std::true_type {};
+
+template<class Environment>
+using ActionList = std::conditional_t<HasActionBuffer<Environment>::value,
+  typename Environment::ActionBuffer, ActionVector<Environment>>;
+
+template<class Environment>
+void fill_available_actions(const Environment& env, ActionList<Environment>& actions) {
+  if constexpr (HasActionBuffer<Environment>::value) {
+    actions.clear();
+    env.get_available_actions(actions);
+  }
+  else
+    actions = env.get_available_actions();
+}
+
+/*
+ * Environments may also provide an order_actions(ActionList&) const that
+ * sorts the available actions from the most to the least promising one.
+ * Progressive widening (see WideningNode) adds the actions in that order.
+ */
+template<class Environment, class = void>
+struct HasActionOrdering : std::false_type {};
+
+template<class Environment>
+struct HasActionOrdering<Environment, std::void_t<
+  decltype(std::declval<const Environment&>().order_actions(
+        std::declval<ActionList<Environment>&>()))>> : std::true_type {};
+
+template<class Environment>
+void order_available_actions(const Environment& env, ActionList<Environment>& actions) {
+  if constexpr (HasActionOrdering<Environment>::value)
+    env.order_actions(actions);
+}
+
+/*
+ * States may carry a 64-bit Zobrist key (a member named key) that the
+ * environment updates incrementally in step(). StateHash then returns the
+ * key as it is and StateEqual compares keys before the full comparison,
+ * instead of rehashing and comparing whole states on every lookup.
+ */
+template<class State, class = void>
+struct HasZobristKey : std::false_type {};
+
+template<class State>
+struct HasZobristKey<State, std::enable_if_t<
+  std::is_same_v<decltype(std::declval<const State&>().key), std::uint64_t>>>
+  : std::true_type {};
+
+template<class State>
+struct StateHash {
+  std::size_t operator()(const State& state) const {
+    if constexpr (HasZobristKey<State>::value)
+      return state.key;
+    else
+      return std::hash<State>()(state);
+  }
+};
+
+template<class State>
+struct StateEqual {
+  bool operator()(const State& lhs, const State& rhs) const {
+    if constexpr (HasZobristKey<State>::value) {
+      if (lhs.key != rhs.key)
+        return false;
+    }
+    return lhs == rhs;
+  }
+};
+
+/*
+ * Hash of actions (for RaveBackup): std::hash when the environment
+ * specializes it, a multiplicative hash of the 64-bit words of the bytes
+ * for plain structs of integers.
+ */
+template<class Action, class = void>
+struct HasStdHash : std::false_type {};
+
+template<class Action>
+struct HasStdHash<Action, std::void_t<
+  decltype(std::hash<Action>()(std::declval<const Action&>()))>> : std::true_type {};
+
+template<class Action>
+struct ActionHash {
+  std::size_t operator()(const Action& action) const {
+    if constexpr (HasStdHash<Action>::value)
+      return std::hash<Action>()(action);
+    else {
+      static_assert(std::has_unique_object_representations_v<Action>,
+          "actions with padding need a std::hash specialization");
+      std::uint64_t words[(sizeof(Action) + 7)/8] = {};
+      std::memcpy(words, &action, sizeof(Action));
+      std::uint64_t hash = 0;
+      for (std::uint64_t word : words)
+        hash = (hash ^ word)*0x9E3779B97F4A7C15ULL;
+      return hash ^ (hash >> 32);
+    }
+  }
+};
+
 template<class Environment>
 struct ActionInfoBase {
   Reward<Environment> expected_return;
@@ -34,30 +172,159 @@ struct ActionInfoBase {
   int visits;
 };
 
+/*
+ * Struct of arrays storage for ActionInfoBase statistics: returns, actions
+ * and visits live in separate contiguous arrays, so selection can scan them
+ * with vector instructions. operator[] returns a proxy with the same
+ * members as ActionInfoBase, which is all that update methods and backups
+ * need.
+ */
 template<class ActionInfo>
+struct SoaActionStorage {
+  typedef decltype(ActionInfo::expected_return) RewardType;
+  typedef decltype(ActionInfo::action) ActionType;
+
+  struct Reference {
+    RewardType& expected_return;
+    ActionType& action;
+    int& visits;
+  };
+
+  struct ConstReference {
+    const RewardType& expected_return;
+    const ActionType& action;
+    const int& visits;
+  };
+
+  std::vector<RewardType> expected_returns;
+  std::vector<ActionType> actions;
+  std::vector<int> visits;
+
+  SoaActionStorage() = default;
+
+  SoaActionStorage(std::size_t size) :
+    expected_returns(size), actions(size), visits(size) {}
+
+  Reference operator[](std::size_t i) {
+    return {expected_returns[i], actions[i], visits[i]};
+  }
+
+  ConstReference operator[](std::size_t i) const {
+    return {expected_returns[i], actions[i], visits[i]};
+  }
+
+  std::size_t size() const { return actions.size(); }
+
+  bool empty() const { return actions.empty(); }
+};
+
+template<class ActionStorage>
+struct IsSoaStorage : std::false_type {};
+
+template<class ActionInfo>
+struct IsSoaStorage<SoaActionStorage<ActionInfo>> : std::true_type {};
+
+template<class ActionInfo, class ActionStorage = std::vector<ActionInfo>>
 struct NodeBase {
-  std::vector<ActionInfo> action_vector;
+  typedef ActionInfo ActionInfoType;
+  typedef ActionStorage ActionStorageType;
+
+  ActionStorage action_vector;
   int maximizing_player, visits;
 
   double get_action_value(int action_index) const {
     return action_vector[action_index].expected_return[maximizing_player];
   }
 
-  template<class Environment>
-  void init(const Environment& environment) {
+  // Visits counted by the selection policies. Decorators that track
+  // simulations still in flight add them here, never to visits itself.
+  int selection_visits() const {
+    return visits;
+  }
+
+  int selection_visits(int action_index) const {
+    return action_vector[action_index].visits;
+  }
+
+  // storage_args are forwarded to the ActionStorage constructor (e.g. an arena)
+  template<class Environment, class... StorageArgs>
+  void init(const Environment& environment, StorageArgs&&... storage_args) {
     visits = 0;
     maximizing_player = environment.get_current_player();
-    auto available_actions = environment.get_available_actions();
-    action_vector.reserve(available_actions.size());
-    for (auto& action : available_actions) {
-      action_vector.emplace_back();
-      action_vector.back().action = action;
-    }
+    ActionList<Environment> available_actions;
+    fill_available_actions(environment, available_actions);
+    action_vector = ActionStorage(available_actions.size(),
+        std::forward<StorageArgs>(storage_args)...);
+    for (unsigned i = 0; i < available_actions.size(); ++i)
+      action_vector[i].action = available_actions[i];
+  }
+};
+
+// Progressive widening schedule: a node with n visits considers
+// ceil(coefficient*(n + 1)^exponent) of its actions
+struct Widening {
+  double coefficient = 1, exponent = 0.5;
+
+  unsigned limit(int visits) const {
+    return std::ceil(coefficient*std::pow(visits + 1, exponent));
+  }
+};
+
+/*
+ * Node that only materializes the actions that its visits allow (see
+ * Widening and WideningNodes), taking them in the order of the environment
+ * (see order_available_actions). action_vector holds those actions, so the
+ * selectors and the backups work on them unchanged, and widen() appends
+ * the next ones as the visits grow. The available actions are generated
+ * again on every widening, which happens a few times in the life of a
+ * node.
+ */
+template<class ActionInfo>
+struct WideningNode : NodeBase<ActionInfo> {
+  unsigned number_of_actions;  // available ones, materialized or not
+
+  template<class Environment>
+  void init(const Environment& environment, const Widening& widening) {
+    this->visits = 0;
+    this->maximizing_player = environment.get_current_player();
+    this->action_vector.clear();
+    add_actions(environment, widening.limit(0));
+  }
+
+  template<class Environment>
+  void widen(const Environment& environment, const Widening& widening) {
+    if (this->action_vector.size() == number_of_actions)
+      return;
+    unsigned limit = widening.limit(this->visits);
+    if (limit > this->action_vector.size())
+      add_actions(environment, limit);
   }
+
+  private:
+    // Reserving the exact size keeps the storage of a node tight
+    template<class Environment>
+    void add_actions(const Environment& environment, unsigned limit) {
+      ActionList<Environment> available_actions;
+      fill_available_actions(environment, available_actions);
+      order_available_actions(environment, available_actions);
+      number_of_actions = available_actions.size();
+      unsigned begin = this->action_vector.size();
+      unsigned end = std::min(limit, number_of_actions);
+      this->action_vector.reserve(end);
+      this->action_vector.resize(end);
+      for (unsigned i = begin; i < end; ++i)
+        this->action_vector[i].action = available_actions[i];
+    }
 };
 
+template<class Node>
+struct IsWideningNode : std::false_type {};
+
 template<class ActionInfo>
-std::ostream& operator<<(std::ostream& out, const NodeBase<ActionInfo>& node) {
+struct IsWideningNode<WideningNode<ActionInfo>> : std::true_type {};
+
+template<class ActionInfo, class ActionStorage>
+std::ostream& operator<<(std::ostream& out, const NodeBase<ActionInfo,ActionStorage>& node) {
   out << "visits: " << node.visits << '\n'
       << "maximizing player: " << node.maximizing_player << '\n'
       << "actions:";
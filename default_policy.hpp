@@ -1,9 +1,14 @@
 #pragma once
 
-#include <random>
+#include <memory>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+#include "array_operations.hpp"
 #include "common.hpp"
+#include "random_utils.hpp"
+#include "thread_pool.hpp"
 
 namespace mcts {
 
@@ -13,11 +18,89 @@ struct RandomPolicy {
 
   RandomPolicy(RandomPtr rng) : rng(std::move(rng)) {}
 
-  template<class Environment>
-  int operator()(const Environment&, const ActionVector<Environment>& actions) {
-    std::uniform_int_distribution<> dist(0, actions.size()-1);
-    return dist(*rng);
+  template<class Environment, class Actions>
+  int operator()(const Environment&, const Actions& actions) {
+    return bounded_random(*rng, actions.size());
   }
 };
 
+/*
+ * Plays the default policy until the end of the episode and returns the
+ * discounted sum of the rewards collected along the way.
+ */
+template<class Environment, class DefaultPolicy>
+Reward<Environment> rollout(
+    Environment sandbox,
+    DefaultPolicy& default_policy,
+    double discount = 1) {
+  Reward<Environment> acc_reward{0};
+  double factor = 1;
+  ActionList<Environment> available_actions;
+  while (!sandbox.is_terminal()) {
+    fill_available_actions(sandbox, available_actions);
+    int selected = default_policy(sandbox, available_actions);
+    acc_reward += factor*sandbox.step(available_actions[selected]);
+    factor *= discount;
+  }
+  return acc_reward;
+}
+
+/*
+ * Default policies that evaluate a leaf as a whole (instead of choosing one
+ * action at a time) expose an evaluate(leaf, discount) method that returns
+ * the estimated discounted return from the leaf. Mcts uses it in place of
+ * the step by step rollout.
+ */
+template<class DefaultPolicy, class Environment, class = void>
+struct IsLeafEvaluator : std::false_type {};
+
+template<class DefaultPolicy, class Environment>
+struct IsLeafEvaluator<DefaultPolicy, Environment, std::void_t<
+  decltype(std::declval<DefaultPolicy&>().evaluate(
+        std::declval<const Environment&>(), 1.0))>> : std::true_type {};
+
+template<class DefaultPolicy, class Environment>
+inline constexpr bool is_leaf_evaluator_v =
+  IsLeafEvaluator<DefaultPolicy,Environment>::value;
+
+/*
+ * Leaf parallelization: runs one rollout per wrapped policy from the same
+ * leaf and returns the mean return. The calling thread plays the last
+ * rollout itself while the pool plays the rest.
+ */
+template<class DefaultPolicy>
+class LeafParallelPolicy {
+  public:
+    LeafParallelPolicy(
+      std::vector<DefaultPolicy> default_policies,
+      std::shared_ptr<multithreading::Pool> pool = nullptr
+    ) :
+      m_default_policies(std::move(default_policies)),
+      m_pool(std::move(pool)) {
+      if (!m_pool)
+        m_pool = std::make_shared<multithreading::Pool>(m_default_policies.size()-1);
+    }
+
+    template<class Environment>
+    Reward<Environment> evaluate(const Environment& leaf, double discount) {
+      std::vector<Reward<Environment>> returns(m_default_policies.size());
+      multithreading::parallel_for(*m_pool, 0U, unsigned(returns.size()),
+          [&](unsigned i) {
+            returns[i] = rollout(leaf, m_default_policies[i], discount);
+          }, 1U);
+      Reward<Environment> mean = returns[0];
+      for (unsigned i = 1; i < returns.size(); ++i)
+        mean += (1.0/(i+1))*(returns[i] - mean);
+      return mean;
+    }
+
+    unsigned rollouts_per_leaf() const {
+      return m_default_policies.size();
+    }
+
+  private:
+    std::vector<DefaultPolicy> m_default_policies;
+    std::shared_ptr<multithreading::Pool> m_pool;
+};
+
 } // mcts
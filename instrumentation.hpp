@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+
+namespace mcts {
+
+/*
+ * Per phase instrumentation of the simulations. It is only collected when
+ * compiled with MCTS_INSTRUMENTATION defined: otherwise the timers are
+ * empty objects and the counters are never touched, so the hot loop pays
+ * nothing for it.
+ */
+#ifdef MCTS_INSTRUMENTATION
+inline constexpr bool instrumentation_enabled = true;
+#else
+inline constexpr bool instrumentation_enabled = false;
+#endif
+
+enum class Phase { selection, expansion, rollout, backup };
+
+/*
+ * The phases are exclusive: the expansion of the leaf happens during the
+ * selection but it is only accounted to the expansion. The memory hits and
+ * misses are the lookups of the selection, the tree depth is the length of
+ * the path and the rollout length the number of steps after the leaf.
+ */
+struct PhaseStatistics {
+  static constexpr int number_of_phases = 4;
+
+  std::array<double,number_of_phases> seconds;
+  long simulations, memory_hits, memory_misses, tree_depth, rollout_length;
+
+  double& seconds_in(Phase phase) {
+    return seconds[static_cast<int>(phase)];
+  }
+
+  double seconds_in(Phase phase) const {
+    return seconds[static_cast<int>(phase)];
+  }
+
+  void update_pass(int path_length, int rollout_steps) {
+    ++simulations;
+    tree_depth += path_length;
+    rollout_length += rollout_steps;
+  }
+
+  double average_tree_depth() const {
+    return simulations? double(tree_depth)/simulations : 0;
+  }
+
+  double average_rollout_length() const {
+    return simulations? double(rollout_length)/simulations : 0;
+  }
+};
+
+// Adds the time between construction and destruction to phase (and takes
+// it away from the enclosing phase, if the timer is nested in another one)
+template<bool enabled = instrumentation_enabled>
+class PhaseTimer {
+  public:
+    PhaseTimer(PhaseStatistics& statistics, Phase phase) :
+      PhaseTimer(statistics, phase, phase) {}
+
+    PhaseTimer(PhaseStatistics& statistics, Phase phase, Phase enclosing) :
+      m_statistics(statistics),
+      m_phase(phase),
+      m_enclosing(enclosing),
+      m_start(std::chrono::steady_clock::now()) {}
+
+    ~PhaseTimer() {
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+      m_statistics.seconds_in(m_phase) += elapsed.count();
+      if (m_enclosing != m_phase)
+        m_statistics.seconds_in(m_enclosing) -= elapsed.count();
+    }
+
+  private:
+    PhaseStatistics& m_statistics;
+    Phase m_phase, m_enclosing;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+template<>
+class PhaseTimer<false> {
+  public:
+    PhaseTimer(PhaseStatistics&, Phase) {}
+    PhaseTimer(PhaseStatistics&, Phase, Phase) {}
+};
+
+inline const char* phase_name(Phase phase) {
+  switch (phase) {
+    case Phase::selection:
+      return "selection";
+    case Phase::expansion:
+      return "expansion";
+    case Phase::rollout:
+      return "rollout";
+    default: //case Phase::backup:
+      return "backup";
+  }
+}
+
+} // mcts
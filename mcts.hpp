@@ -1,22 +1,40 @@
 #pragma once
 
+#include <atomic>
 #include <ostream>
 #include <chrono>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <queue>
+#include <type_traits>
+#include <string>
+#include <unordered_set>
+#include <utility>
 
 #include "backup.hpp"
 #include "common.hpp"
 #include "default_policy.hpp"
+#include "instrumentation.hpp"
 #include "memory_utils.hpp"
 #include "select.hpp"
+#include "snapshot.hpp"
+#include "thread_pool.hpp"
+#include "time_manager.hpp"
 
 namespace mcts {
 
 struct Statistics {
   double elapsed_last_call, elapsed_per_call,
-         time_per_simulation, time_per_simulation_last;
+         time_per_simulation, time_per_simulation_last,
+         time_saved, time_saved_last, time_extended, time_extended_last;
   int number_of_calls, max_episode_length,
-      number_of_simulations, number_of_simulations_last;
+      number_of_simulations, number_of_simulations_last,
+      pondering_simulations, pondering_simulations_last,
+      reused_simulations, reused_simulations_last;
+  // only gathered by the instrumented builds
+  PhaseStatistics phases;
 
   void update_episode_length(int length) {
     if (length > max_episode_length)
@@ -34,24 +52,263 @@ struct Statistics {
     time_per_simulation += (double(nsim)/number_of_simulations)*
       (time_per_simulation_last - time_per_simulation);
   }
+
+  // Time left unused of (or taken beyond) the soft budget of a managed search
+  void update_time_management(double saved, double extended) {
+    time_saved += saved;
+    time_saved_last = saved;
+    time_extended += extended;
+    time_extended_last = extended;
+  }
+
+  void update_pondering(int nsim, int reused) {
+    pondering_simulations += nsim;
+    pondering_simulations_last = nsim;
+    reused_simulations += reused;
+    reused_simulations_last = reused;
+  }
 };
 
-std::ostream& operator<<(std::ostream& out, const Statistics& stats) {
+inline std::ostream& operator<<(std::ostream& out, const Statistics& stats) {
   out << "Last call\n"
       << "---------\n"
       << "Elapsed: " << (stats.elapsed_last_call*1000) << "ms\n"
       << "Number of simulations: " << stats.number_of_simulations_last << '\n'
-      << "Time per simulation: " << (stats.time_per_simulation_last*1000) << "ms\n\n"
+      << "Time per simulation: " << (stats.time_per_simulation_last*1000) << "ms\n"
+      << "Pondering simulations: " << stats.pondering_simulations_last
+      << " (" << stats.reused_simulations_last << " reused)\n"
+      << "Time saved: " << (stats.time_saved_last*1000) << "ms, "
+      << "extended: " << (stats.time_extended_last*1000) << "ms\n\n"
       << "Overall\n"
       << "-------\n"
       << "Number of calls: " << stats.number_of_calls << '\n'
       << "Time per call: " << (stats.elapsed_per_call*1000) << "ms\n"
       << "Number of simulations: " << stats.number_of_simulations << '\n'
       << "Time per simulation: " << (stats.time_per_simulation*1000) << "ms\n"
+      << "Pondering simulations: " << stats.pondering_simulations
+      << " (" << stats.reused_simulations << " reused)\n"
+      << "Time saved: " << (stats.time_saved*1000) << "ms, "
+      << "extended: " << (stats.time_extended*1000) << "ms\n"
       << "Maximum episode length: " << stats.max_episode_length;
     return out;
 }
 
+// One JSON object with the overall statistics and the phases of the passes
+inline void write_json(std::ostream& out, const Statistics& stats) {
+  const PhaseStatistics& phases = stats.phases;
+  auto flags = out.flags(std::ios::fmtflags());
+  auto precision = out.precision(9);
+  out << "{\"number_of_calls\": " << stats.number_of_calls
+      << ", \"number_of_simulations\": " << stats.number_of_simulations
+      << ", \"time_per_call_s\": " << stats.elapsed_per_call
+      << ", \"time_per_simulation_s\": " << stats.time_per_simulation
+      << ", \"max_episode_length\": " << stats.max_episode_length
+      << ", \"instrumented\": " << (instrumentation_enabled? "true" : "false")
+      << ", \"phases\": {";
+  for (int i = 0; i < PhaseStatistics::number_of_phases; ++i) {
+    out << (i? ", " : "") << '"' << phase_name(Phase(i)) << "_s\": "
+        << phases.seconds[i];
+  }
+  out << "}, \"instrumented_simulations\": " << phases.simulations
+      << ", \"memory_hits\": " << phases.memory_hits
+      << ", \"memory_misses\": " << phases.memory_misses
+      << ", \"average_tree_depth\": " << phases.average_tree_depth()
+      << ", \"average_rollout_length\": " << phases.average_rollout_length()
+      << '}';
+  out.flags(flags);
+  out.precision(precision);
+}
+
+// A CSV row of the same fields (preceded by the header row if asked to)
+inline void write_csv(std::ostream& out, const Statistics& stats, bool header = true) {
+  const PhaseStatistics& phases = stats.phases;
+  auto flags = out.flags(std::ios::fmtflags());
+  auto precision = out.precision(9);
+  if (header) {
+    out << "number_of_calls,number_of_simulations,time_per_call_s,"
+           "time_per_simulation_s,max_episode_length,instrumented";
+    for (int i = 0; i < PhaseStatistics::number_of_phases; ++i)
+      out << ',' << phase_name(Phase(i)) << "_s";
+    out << ",instrumented_simulations,memory_hits,memory_misses,"
+           "average_tree_depth,average_rollout_length\n";
+  }
+  out << stats.number_of_calls << ',' << stats.number_of_simulations << ','
+      << stats.elapsed_per_call << ',' << stats.time_per_simulation << ','
+      << stats.max_episode_length << ',' << instrumentation_enabled;
+  for (int i = 0; i < PhaseStatistics::number_of_phases; ++i)
+    out << ',' << phases.seconds[i];
+  out << ',' << phases.simulations << ',' << phases.memory_hits << ','
+      << phases.memory_misses << ',' << phases.average_tree_depth() << ','
+      << phases.average_rollout_length() << '\n';
+  out.flags(flags);
+  out.precision(precision);
+}
+
+/*
+ * Frees every node of the memory that cannot be reached from root through
+ * visited actions, so the whole capacity is available to the live subtree
+ * (and the statistics gathered below root are reused by the next search).
+ * When a pool is given, the evicted nodes are destroyed in one of its
+ * workers. Returns the number of nodes freed.
+ */
+template<class Environment, class Memory>
+std::size_t retain_subtree(
+    Memory& memory,
+    const Environment& root,
+    multithreading::Pool* pool = nullptr) {
+  typedef typename Memory::mapped_type Node;
+  const Memory& lookup = memory;
+  std::unordered_set<const Node*> reachable;
+  std::queue<Environment> frontier;
+  reachable.reserve(memory.size());
+  auto root_it = lookup.find(root.get_state());
+  if (root_it != lookup.end()) {
+    reachable.insert(&root_it->second);
+    frontier.push(root);
+  }
+  while (!frontier.empty()) {
+    const Environment& env = frontier.front();
+    const Node& node = lookup.find(env.get_state())->second;
+    for (unsigned i = 0; i < node.action_vector.size(); ++i) {
+      const auto& action_info = node.action_vector[i];
+      if (!action_info.visits)
+        continue;
+      Environment child = env;
+      child.step(action_info.action);
+      auto child_it = lookup.find(child.get_state());
+      if (child_it != lookup.end() && reachable.insert(&child_it->second).second)
+        frontier.push(std::move(child));
+    }
+    frontier.pop();
+  }
+  auto garbage = memory.extract_if([&reachable](const auto& entry) {
+    return !reachable.count(&entry.second);
+  });
+  std::size_t number_of_freed = garbage.size();
+  if (pool && number_of_freed) {
+    auto shared_garbage = std::make_shared<decltype(garbage)>(std::move(garbage));
+    pool->add_job([shared_garbage] { shared_garbage->clear(); });
+  }
+  return number_of_freed;
+}
+
+/*
+ * Root statistics of a running search, taken between two simulations.
+ */
+template<class Environment>
+struct SearchProgress {
+  int number_of_simulations = 0;
+  double elapsed = 0;
+  int root_visits = 0;
+  // most visited action so far, -1 while the root has not been expanded
+  int best_action_index = -1;
+  std::vector<ActionInfoBase<Environment>> root_actions;
+};
+
+/*
+ * Shared between an asynchronous search and its handle. The search polls
+ * the cancel flag after every simulation and publishes a SearchProgress
+ * (calling the callback, if any, from the searching thread) every
+ * interval simulations and when it ends.
+ */
+template<class Environment>
+class SearchControl {
+  public:
+    typedef std::function<void(const SearchProgress<Environment>&)> Callback;
+
+    SearchControl(int interval, Callback callback) :
+      m_interval(interval > 0? interval : 1),
+      m_callback(std::move(callback)),
+      m_cancelled(false) {}
+
+    void cancel() {
+      m_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    bool is_cancelled() const {
+      return m_cancelled.load(std::memory_order_relaxed);
+    }
+
+    bool is_checkpoint(int number_of_simulations) const {
+      return number_of_simulations % m_interval == 0;
+    }
+
+    void publish(SearchProgress<Environment> progress) {
+      if (m_callback)
+        m_callback(progress);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_progress = std::move(progress);
+    }
+
+    SearchProgress<Environment> progress() const {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_progress;
+    }
+
+  private:
+    int m_interval;
+    Callback m_callback;
+    std::atomic<bool> m_cancelled;
+    mutable std::mutex m_mutex;
+    SearchProgress<Environment> m_progress;
+};
+
+template<class Environment>
+class SearchHandle {
+  public:
+    SearchHandle(
+      std::shared_ptr<SearchControl<Environment>> control,
+      std::future<Action<Environment>> result
+    ) :
+      m_control(std::move(control)),
+      m_result(std::move(result)) {}
+
+    // The search stops after the simulation that is running
+    void cancel() {
+      m_control->cancel();
+    }
+
+    bool is_ready() const {
+      return m_result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // Latest published progress
+    SearchProgress<Environment> progress() const {
+      return m_control->progress();
+    }
+
+    // Waits for the search to end; can only be called once
+    Action<Environment> get() {
+      return m_result.get();
+    }
+
+  private:
+    std::shared_ptr<SearchControl<Environment>> m_control;
+    std::future<Action<Environment>> m_result;
+};
+
+// Progress of a search whose root is the given node (null if not expanded)
+template<class Environment, class Node>
+SearchProgress<Environment> make_search_progress(
+    const Node* root,
+    int number_of_simulations,
+    double elapsed) {
+  SearchProgress<Environment> progress;
+  progress.number_of_simulations = number_of_simulations;
+  progress.elapsed = elapsed;
+  if (root) {
+    progress.root_visits = root->visits;
+    progress.best_action_index = MostVisitedSelect()(*root);
+    progress.root_actions.reserve(root->action_vector.size());
+    for (unsigned i = 0; i < root->action_vector.size(); ++i) {
+      const auto& action_info = root->action_vector[i];
+      progress.root_actions.push_back(
+          {action_info.expected_return, action_info.action, action_info.visits});
+    }
+  }
+  return progress;
+}
+
 template<class Environment>
 class MctsBase {
   public:
@@ -64,24 +321,125 @@ class MctsBase {
       int simulation_limit = -1
     ) = 0;
 
+    /*
+     * Non blocking search that runs in a worker of the pool. The returned
+     * handle cancels the search, reads its latest progress and waits for
+     * the action. The callback, if any, is called from the worker every
+     * callback_interval simulations. The algorithm must not be used until
+     * the search has finished.
+     */
+    SearchHandle<Environment> search_async(
+      const Environment& env,
+      multithreading::Pool& pool,
+      double timeout_s = -1,
+      int simulation_limit = -1,
+      int callback_interval = 1000,
+      typename SearchControl<Environment>::Callback callback = nullptr
+    ) {
+      auto control = std::make_shared<SearchControl<Environment>>(
+          callback_interval, std::move(callback));
+      auto result = pool.background_async([this, env, control, timeout_s, simulation_limit] {
+        return controlled_search(env, timeout_s, simulation_limit, *control);
+      });
+      return SearchHandle<Environment>(std::move(control), std::move(result));
+    }
+
+    /*
+     * Search whose budget comes from the game clock of the time manager,
+     * which is charged with the time actually used.
+     */
+    Action<Environment> managed_search(
+      const Environment& env,
+      TimeManager& time_manager,
+      std::ostream* log = nullptr
+    ) {
+      Action<Environment> action = budgeted_search(env, log, time_manager.allocate());
+      time_manager.consume(m_statistics.elapsed_last_call);
+      return action;
+    }
+
     const Statistics& get_statistics() const {
       return m_statistics;
     }
 
     virtual void reset() { }
 
+    /*
+     * Called after the actual moves have been played: keeps the subtree
+     * below the new root and frees the rest of the memory (in the given
+     * pool, if any). Returns the number of freed nodes.
+     */
+    virtual std::size_t reroot(
+      const Environment&,
+      multithreading::Pool* = nullptr
+    ) {
+      return 0;
+    }
+
+    /*
+     * Keeps searching from env (the position after our move) in a worker of
+     * the pool while the opponent thinks. stop_pondering must be called
+     * with the position actually reached before anything else: it stops the
+     * background search after the running simulation and reroots, so the
+     * simulations pondered below the actual move are kept and count toward
+     * the simulation limit of the next search.
+     */
+    virtual void ponder(const Environment&, multithreading::Pool&) { }
+
+    virtual std::size_t stop_pondering(
+      const Environment& env,
+      multithreading::Pool* pool = nullptr
+    ) {
+      return reroot(env, pool);
+    }
+
     virtual ~MctsBase() = default;
 
   protected:
+    /*
+     * Search within a move budget. The default one just searches for the
+     * soft budget: early stopping and extensions need support from the
+     * simulation loop of the algorithm.
+     */
+    virtual Action<Environment> budgeted_search(
+      const Environment& env,
+      std::ostream* log,
+      const MoveBudget& budget
+    ) {
+      return search(env, log, budget.soft_s);
+    }
+
+    /*
+     * Search that honours the control. The default one only publishes the
+     * final progress: cancellation and intermediate progress need support
+     * from the simulation loop of the algorithm.
+     */
+    virtual Action<Environment> controlled_search(
+      const Environment& env,
+      double timeout_s,
+      int simulation_limit,
+      SearchControl<Environment>& control
+    ) {
+      Action<Environment> action = search(env, nullptr, timeout_s, simulation_limit);
+      SearchProgress<Environment> progress;
+      progress.number_of_simulations = m_statistics.number_of_simulations_last;
+      progress.elapsed = m_statistics.elapsed_last_call;
+      control.publish(std::move(progress));
+      return action;
+    }
+
     Statistics m_statistics;
 };
 
 template< class Environment,
           class Select,
           class DefaultPolicy,
-          class Backup >
+          class Backup,
+          template<class...> class Memory = memory::LruMap >
 class Mcts : public MctsBase<Environment> {
   public:
+    typedef typename Backup::Node Node;
+
     Mcts(
       Select select,
       DefaultPolicy default_policy,
@@ -91,7 +449,12 @@ class Mcts : public MctsBase<Environment> {
       m_select(std::move(select)),
       m_default_policy(std::move(default_policy)),
       m_backup(std::move(backup)),
-      m_memory(memory_capacity) {}
+      m_memory(memory_capacity),
+      m_ponder_credit(0) {}
+
+    virtual ~Mcts() {
+      stop_background_search();
+    }
 
     virtual Action<Environment> search(
       const Environment& env,
@@ -99,24 +462,175 @@ class Mcts : public MctsBase<Environment> {
       double timeout_s = -1,
       int simulation_limit = -1
     ) override {
+      return run_search(env, log, {timeout_s, timeout_s, 0}, false, simulation_limit, nullptr);
+    }
+
+    virtual void reset() override {
+      stop_background_search();
+      m_memory.clear();
+      m_ponder_credit = 0;
+    }
+
+    virtual std::size_t reroot(
+      const Environment& env,
+      multithreading::Pool* pool = nullptr
+    ) override {
+      stop_background_search();
+      // the arena is not thread safe: arena backed nodes are freed right here
+      if constexpr (uses_arena)
+        pool = nullptr;
+      return retain_subtree(m_memory, env, pool);
+    }
+
+    virtual void ponder(const Environment& env, multithreading::Pool& pool) override {
+      stop_background_search();
+      m_ponder_root = env;
+      m_ponder_start_visits.clear();
+      if (const Node* root = find_node(env.get_state())) {
+        for (unsigned i = 0; i < root->action_vector.size(); ++i)
+          m_ponder_start_visits.push_back(root->action_vector[i].visits);
+      }
+      m_stop_pondering = false;
+      m_pondering = pool.background_async([this] {
+        int number_of_simulations = 0;
+        while (!m_stop_pondering.load(std::memory_order_relaxed)) {
+          single_pass(m_ponder_root);
+          ++number_of_simulations;
+        }
+        return number_of_simulations;
+      });
+    }
+
+    virtual std::size_t stop_pondering(
+      const Environment& env,
+      multithreading::Pool* pool = nullptr
+    ) override {
+      if (!m_pondering.valid())
+        return reroot(env, pool);
+      int number_of_simulations = stop_background_search();
+      int reused = pondered_visits(env);
+      this->m_statistics.update_pondering(number_of_simulations, reused);
+      m_ponder_credit = reused;
+      return reroot(env, pool);
+    }
+
+    const Node* find_node(const State<Environment>& state) const {
+      auto it = m_memory.find(state);
+      return it == m_memory.end()? nullptr : &it->second;
+    }
+
+    std::size_t memory_usage() const {
+      return m_memory.size();
+    }
+
+    /*
+     * Writes the nodes in memory to a snapshot file. It must not be called
+     * while pondering.
+     */
+    void save_snapshot(const std::string& path) const {
+      Snapshot<Environment>::write(path, m_memory);
+    }
+
+    /*
+     * Nodes found in the snapshot start with its statistics instead of from
+     * scratch when they are expanded. Null disables the warm start.
+     */
+    void set_warm_start(std::shared_ptr<const Snapshot<Environment>> snapshot) {
+      m_warm_start = std::move(snapshot);
+    }
+
+  protected:
+    virtual Action<Environment> controlled_search(
+      const Environment& env,
+      double timeout_s,
+      int simulation_limit,
+      SearchControl<Environment>& control
+    ) override {
+      MoveBudget budget{timeout_s, timeout_s, 0};
+      return run_search(env, nullptr, budget, false, simulation_limit, &control);
+    }
+
+    virtual Action<Environment> budgeted_search(
+      const Environment& env,
+      std::ostream* log,
+      const MoveBudget& budget
+    ) override {
+      return run_search(env, log, budget, true, -1, nullptr);
+    }
+
+  private:
+    typedef Memory<State<Environment>,Node,
+                   StateHash<State<Environment>>,StateEqual<State<Environment>>> MemoryType;
+    typedef TreePath<typename MemoryType::iterator> Path;
+
+    static constexpr bool uses_arena =
+      memory::IsArenaArray<typename Node::ActionStorageType>::value;
+
+    static constexpr bool uses_widening = IsWideningNode<Node>::value;
+
+    // Backups that take the actions of the episode (such as RaveBackup)
+    static constexpr bool records_played_actions = std::is_invocable_v<Backup&,
+      const Path&, const RewardVector<Environment>&, const PlayedActions<Environment>&>;
+
+    // Simulations between two checks of the early stopping rules
+    static constexpr int STOP_CHECK_INTERVAL = 64;
+
+    /*
+     * With adaptive = false the search runs for the soft budget. Otherwise
+     * it stops as soon as is_settled says so, or at the hard budget.
+     */
+    Action<Environment> run_search(
+      const Environment& env,
+      std::ostream* log,
+      MoveBudget budget,
+      bool adaptive,
+      int simulation_limit,
+      SearchControl<Environment>* control
+    ) {
       using namespace std::chrono;
-      if (timeout_s < 0)
-        timeout_s = std::numeric_limits<double>::infinity();
+      stop_background_search();
+      int ponder_credit = std::exchange(m_ponder_credit, 0);
+      if (budget.soft_s < 0)
+        budget.soft_s = std::numeric_limits<double>::infinity();
+      if (!adaptive || budget.hard_s < budget.soft_s)
+        budget.hard_s = budget.soft_s;
       if (simulation_limit < 0)
         simulation_limit = std::numeric_limits<int>::max();
-      duration<double> timeout(timeout_s), elapsed(0.0);
+      else
+        simulation_limit -= ponder_credit;
+      duration<double> soft(budget.soft_s), hard(budget.hard_s), elapsed(0.0);
       auto start = steady_clock::now();
       int number_of_simulations = 0;
       do {
         single_pass(env);
         ++number_of_simulations;
         elapsed = steady_clock::now() - start;
+        if (control) {
+          if (control->is_cancelled())
+            break;
+          if (control->is_checkpoint(number_of_simulations))
+            control->publish(make_search_progress<Environment>(
+                  find_node(env.get_state()), number_of_simulations, elapsed.count()));
+        }
+        if (adaptive && number_of_simulations % STOP_CHECK_INTERVAL == 0 &&
+            is_settled(env, number_of_simulations, simulation_limit,
+              elapsed.count(), budget))
+          break;
       } while (number_of_simulations < simulation_limit &&
-               elapsed < timeout);
+               elapsed < hard);
       this->m_statistics.update(number_of_simulations, elapsed.count());
+      if (adaptive) {
+        this->m_statistics.update_time_management(
+            std::max(soft - elapsed, duration<double>(0)).count(),
+            std::max(elapsed - soft, duration<double>(0)).count());
+      }
       MostVisitedSelect select;
       const Node& root = m_memory.find(env.get_state())->second;
       int argmax = select(root);
+      if (control) {
+        control->publish(make_search_progress<Environment>(
+              &root, number_of_simulations, elapsed.count()));
+      }
       if (log) {
         *log << this->m_statistics << "\n\n"
              << "Current node\n"
@@ -129,48 +643,142 @@ class Mcts : public MctsBase<Environment> {
       return root.action_vector[argmax].action;
     }
 
-    virtual void reset() override {
-      m_memory.clear();
+    /*
+     * Before the soft budget: true when the visits that the rest of it can
+     * give (estimated with the current rate) cannot make the second most
+     * visited action overtake the first one. After it: true as soon as the
+     * two best actions are not close, or when the extension cannot change
+     * the most visited one either.
+     */
+    bool is_settled(
+      const Environment& env,
+      int number_of_simulations,
+      int simulation_limit,
+      double elapsed,
+      const MoveBudget& budget
+    ) const {
+      const Node* root = find_node(env.get_state());
+      if (!root)
+        return false;
+      auto[best, second] = top_two_visits(*root);
+      bool past_soft = elapsed >= budget.soft_s;
+      if (past_soft && second < budget.closeness*best)
+        return true;
+      double horizon = (past_soft? budget.hard_s : budget.soft_s) - elapsed;
+      double remaining = std::min(number_of_simulations/elapsed*horizon,
+          double(simulation_limit - number_of_simulations));
+      return best - second > remaining;
     }
 
-  private:
-    typedef typename Backup::Node Node;
+    // Returns the number of simulations pondered
+    int stop_background_search() {
+      if (!m_pondering.valid())
+        return 0;
+      m_stop_pondering = true;
+      return m_pondering.get();
+    }
 
+    // Visits that the pondering added to the action leading to env
+    int pondered_visits(const Environment& env) const {
+      const Node* root = find_node(m_ponder_root.get_state());
+      if (!root)
+        return 0;
+      StateEqual<State<Environment>> equal;
+      for (unsigned i = 0; i < root->action_vector.size(); ++i) {
+        Environment child = m_ponder_root;
+        child.step(root->action_vector[i].action);
+        if (equal(child.get_state(), env.get_state())) {
+          int start_visits = i < m_ponder_start_visits.size()? m_ponder_start_visits[i] : 0;
+          return root->action_vector[i].visits - start_visits;
+        }
+      }
+      return 0;
+    }
+
+    // The path and rewards buffers are reused by every pass
     void single_pass(Environment sandbox) {
-      TreePath<Environment> tree_path;
-      RewardVector<Environment> rewards;
-      tree_path.reserve(this->m_statistics.max_episode_length);
-      rewards.reserve(this->m_statistics.max_episode_length);
-      tree_sim(sandbox, tree_path, rewards);
-      default_sim(sandbox, rewards);
-      m_backup(m_memory, tree_path, rewards);
+      PhaseStatistics& phases = this->m_statistics.phases;
+      m_tree_path.clear();
+      m_rewards.clear();
+      m_played_actions.clear();
+      {
+        PhaseTimer<> timer(phases, Phase::selection);
+        tree_sim(sandbox, m_tree_path, m_rewards);
+      }
+      {
+        PhaseTimer<> timer(phases, Phase::rollout);
+        default_sim(sandbox, m_rewards);
+      }
+      {
+        PhaseTimer<> timer(phases, Phase::backup);
+        if constexpr (records_played_actions)
+          m_backup(m_tree_path, m_rewards, m_played_actions);
+        else
+          m_backup(m_tree_path, m_rewards);
+        for (const auto& step : m_tree_path)
+          m_memory.unpin(step.handle);
+      }
+      if constexpr (instrumentation_enabled)
+        phases.update_pass(m_tree_path.size(), m_rewards.size() - m_tree_path.size());
       this->m_statistics.update_episode_length(sandbox.get_turn());
     }
 
-    Node& expand(const Environment& env) {
-      Node& node = m_memory[env.get_state()];
-      node.init(env);
-      return node;
+    void expand(Node& node, const Environment& env) {
+      if constexpr (uses_widening)
+        node.init(env, m_backup.widening);
+      else if constexpr (uses_arena)
+        node.init(env, m_arena);
+      else
+        node.init(env);
+      if (m_warm_start)
+        warm_start(node, env);
     }
 
+    // Copies the statistics of the snapshot if it has the same actions
+    void warm_start(Node& node, const Environment& env) {
+      const auto* entry = m_warm_start->find(env.get_state());
+      if (!entry || entry->number_of_actions != node.action_vector.size())
+        return;
+      const auto* actions = m_warm_start->actions(*entry);
+      for (unsigned i = 0; i < node.action_vector.size(); ++i) {
+        if (!(actions[i].action == node.action_vector[i].action))
+          return;
+      }
+      node.visits = entry->visits;
+      for (unsigned i = 0; i < node.action_vector.size(); ++i) {
+        auto&& info = node.action_vector[i];
+        info.expected_return = actions[i].expected_return;
+        info.visits = actions[i].visits;
+      }
+    }
+
+    // Nodes are pinned as they enter the path, so the handles stay valid
+    // until the backup is done
     void tree_sim(
       Environment& sandbox,
-      TreePath<Environment>& tree_path,
+      Path& tree_path,
       RewardVector<Environment>& rewards
     ) {
       bool leaf_or_terminal = sandbox.is_terminal();
       while (!leaf_or_terminal) {
-        Node* node;
-        auto it = m_memory.find(sandbox.get_state());
-        if (it == m_memory.end()) {
-          node = &expand(sandbox);
+        auto[it, inserted] = m_memory.try_emplace(sandbox.get_state());
+        Node& node = it->second;
+        if (inserted) {
+          PhaseTimer<> timer(this->m_statistics.phases, Phase::expansion, Phase::selection);
+          expand(node, sandbox);
           leaf_or_terminal = true;
         }
-        else
-          node = &(it->second);
-        int selected = m_select(*node);
-        tree_path.emplace_back(sandbox.get_state(), selected);
-        rewards.push_back(sandbox.step(node->action_vector[selected].action));
+        else if constexpr (uses_widening)
+          node.widen(sandbox, m_backup.widening);
+        if constexpr (instrumentation_enabled)
+          ++(inserted? this->m_statistics.phases.memory_misses
+                     : this->m_statistics.phases.memory_hits);
+        m_memory.pin(it);
+        int selected = m_select(node);
+        tree_path.push_back({it, selected});
+        if constexpr (records_played_actions)
+          m_played_actions.push_back({node.action_vector[selected].action, node.maximizing_player});
+        rewards.push_back(sandbox.step(node.action_vector[selected].action));
         leaf_or_terminal = leaf_or_terminal || sandbox.is_terminal();
       }
     }
@@ -179,18 +787,36 @@ class Mcts : public MctsBase<Environment> {
       Environment& sandbox,
       RewardVector<Environment>& rewards
     ) {
-      while (!sandbox.is_terminal()) {
-        auto available_actions = sandbox.get_available_actions();
-        int selected = m_default_policy(sandbox, available_actions);
-        rewards.push_back(sandbox.step(available_actions[selected]));
+      if constexpr (is_leaf_evaluator_v<DefaultPolicy,Environment>) {
+        if (!sandbox.is_terminal())
+          rewards.push_back(m_default_policy.evaluate(sandbox, m_backup.discount));
+      }
+      else {
+        ActionList<Environment> available_actions;
+        while (!sandbox.is_terminal()) {
+          fill_available_actions(sandbox, available_actions);
+          int selected = m_default_policy(sandbox, available_actions);
+          if constexpr (records_played_actions)
+            m_played_actions.push_back({available_actions[selected], sandbox.get_current_player()});
+          rewards.push_back(sandbox.step(available_actions[selected]));
+        }
       }
     }
 
     Select m_select;
     DefaultPolicy m_default_policy;
     Backup m_backup;
-    memory::LruMap<State<Environment>,Node> m_memory;
-    //std::unordered_map<State<Environment>,Node> m_memory;
+    memory::Arena<typename Node::ActionInfoType> m_arena;
+    MemoryType m_memory;
+    std::shared_ptr<const Snapshot<Environment>> m_warm_start;
+    Path m_tree_path;
+    RewardVector<Environment> m_rewards;
+    PlayedActions<Environment> m_played_actions;
+    Environment m_ponder_root;
+    std::vector<int> m_ponder_start_visits;
+    std::atomic<bool> m_stop_pondering;
+    std::future<int> m_pondering;
+    int m_ponder_credit;
 };
 
 template<class Environment, class... Args>
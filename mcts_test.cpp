@@ -35,6 +35,7 @@ int main() {
          << "-----------\n"
          << action << endl << endl;
     env.step(action);
+    algorithm->reroot(env);
   }
   cout << "Turn " << env.get_turn() << endl;
   cout << "-------------------" << endl;
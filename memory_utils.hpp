@@ -1,11 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <list>
 #include <memory>
+#include <new>
 #include <stack>
+#include <stdexcept>
+#include <string>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace mcts::memory {
 
@@ -58,6 +72,153 @@ class PoolAllocator {
     std::stack<T*> m_pool;
 };
 
+/*
+ * Bump allocator for arrays of T. Memory is carved sequentially out of big
+ * blocks, and arrays returned with deallocate are kept in per-length free
+ * lists so that evicted nodes make room for new ones of the same width.
+ * Not thread safe.
+ */
+template<class T>
+class Arena {
+  public:
+    Arena(std::size_t block_size = 4096) :
+      m_block_size(block_size), m_top(0), m_in_use(0) {}
+
+    Arena(const Arena&) = delete;
+
+    Arena& operator=(const Arena&) = delete;
+
+    T* allocate(std::size_t n) {
+      if (!n)
+        return nullptr;
+      m_in_use += n;
+      if (n < m_free_lists.size() && !m_free_lists[n].empty()) {
+        T* ptr = m_free_lists[n].back();
+        m_free_lists[n].pop_back();
+        return ptr;
+      }
+      if (m_blocks.empty() || m_top + n > m_blocks.back().second) {
+        std::size_t size = std::max(n, m_block_size);
+        m_blocks.emplace_back(static_cast<T*>(::operator new(sizeof(T)*size)), size);
+        m_top = 0;
+      }
+      T* ptr = m_blocks.back().first + m_top;
+      m_top += n;
+      return ptr;
+    }
+
+    void deallocate(T* ptr, std::size_t n) {
+      if (!n)
+        return;
+      m_in_use -= n;
+      if (n >= m_free_lists.size())
+        m_free_lists.resize(n+1);
+      m_free_lists[n].push_back(ptr);
+    }
+
+    std::size_t bytes_reserved() const {
+      std::size_t elements = 0;
+      for (const auto& block : m_blocks)
+        elements += block.second;
+      return elements*sizeof(T);
+    }
+
+    std::size_t bytes_in_use() const {
+      return m_in_use*sizeof(T);
+    }
+
+    ~Arena() {
+      for (auto& block : m_blocks)
+        ::operator delete(block.first);
+    }
+
+  private:
+    std::size_t m_block_size, m_top, m_in_use;
+    std::vector<std::pair<T*,std::size_t>> m_blocks;
+    std::vector<std::vector<T*>> m_free_lists;
+};
+
+/*
+ * Fixed length array allocated from an Arena, which must outlive it. The
+ * memory goes back to the arena when the array is destroyed.
+ */
+template<class T>
+class ArenaArray {
+  public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    ArenaArray() : m_data(nullptr), m_size(0), m_arena(nullptr) {}
+
+    ArenaArray(std::size_t size, Arena<T>& arena) :
+      m_data(arena.allocate(size)), m_size(size), m_arena(&arena) {
+      std::uninitialized_value_construct_n(m_data, m_size);
+    }
+
+    ArenaArray(ArenaArray&& other) noexcept :
+      m_data(other.m_data), m_size(other.m_size), m_arena(other.m_arena) {
+      other.m_data = nullptr;
+      other.m_size = 0;
+    }
+
+    ArenaArray& operator=(ArenaArray&& other) noexcept {
+      if (this != &other) {
+        release();
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_arena = other.m_arena;
+        other.m_data = nullptr;
+        other.m_size = 0;
+      }
+      return *this;
+    }
+
+    ~ArenaArray() {
+      release();
+    }
+
+    std::size_t size() const { return m_size; }
+
+    bool empty() const { return !m_size; }
+
+    T& operator[](std::size_t i) { return m_data[i]; }
+
+    const T& operator[](std::size_t i) const { return m_data[i]; }
+
+    iterator begin() { return m_data; }
+
+    iterator end() { return m_data + m_size; }
+
+    const_iterator begin() const { return m_data; }
+
+    const_iterator end() const { return m_data + m_size; }
+
+  private:
+    void release() {
+      if (m_data) {
+        std::destroy_n(m_data, m_size);
+        m_arena->deallocate(m_data, m_size);
+      }
+    }
+
+    T* m_data;
+    std::size_t m_size;
+    Arena<T>* m_arena;
+};
+
+template<class T>
+struct IsArenaArray : std::false_type {};
+
+template<class T>
+struct IsArenaArray<ArenaArray<T>> : std::true_type {};
+
+/*
+ * Map with a fixed capacity that evicts the least recently used element.
+ * Pinned elements are kept apart from the recency order, so they are never
+ * evicted (the map can temporarily exceed its capacity if everything else
+ * is pinned) and iteration skips them.
+ */
 template< class Key,
           class T,
           class Hash = std::hash<Key>,
@@ -73,7 +234,16 @@ class LruMap {
     typedef Allocator allocator_type;
 
   private:
-    typedef std::list<value_type, Allocator> List;
+    struct Entry : value_type {
+      template<class... Args>
+      Entry(Args&&... args) : value_type(std::forward<Args>(args)...), pins(0) {}
+
+      int pins;
+    };
+
+    typedef std::allocator_traits<Allocator> AllocatorTraits;
+    typedef typename AllocatorTraits::template rebind_alloc<Entry> ListAllocator;
+    typedef std::list<Entry, ListAllocator> List;
 
   public:
     typedef typename List::iterator iterator;
@@ -82,7 +252,6 @@ class LruMap {
   private:
     typedef std::reference_wrapper<const Key> KeyRef;
     typedef std::pair<const KeyRef,iterator> KeyRefTPair;
-    typedef std::allocator_traits<Allocator> AllocatorTraits;
     typedef typename AllocatorTraits::template rebind_alloc<KeyRefTPair> MapAllocator;
     typedef std::unordered_map<KeyRef,iterator,Hash,KeyEqual,MapAllocator> HashMap;
 
@@ -94,7 +263,8 @@ class LruMap {
       Allocator alloc = Allocator()
     ) :
       m_capacity(capacity),
-      m_list(alloc),
+      m_list(ListAllocator(alloc)),
+      m_pinned(ListAllocator(alloc)),
       m_map(1.4*capacity, hash, key_equal, MapAllocator(alloc)) {
     }
 
@@ -122,18 +292,42 @@ class LruMap {
       return it->second;
     }
 
-    T& operator[](const Key& key) {
+    // Lookup that leaves the recency order untouched
+    const_iterator find(const Key& key) const {
+      auto it = m_map.find(key);
+      if (it == m_map.end())
+        return m_list.end();
+      return it->second;
+    }
+
+    // Inserts a default constructed value if the key is missing
+    std::pair<iterator,bool> try_emplace(const Key& key) {
       auto it = find(key);
       if (it != m_list.end())
-        return it->second;
-      if (m_list.size() == m_capacity)
+        return {it, false};
+      if (size() >= m_capacity && !m_list.empty())
         pop_least_recent();
       add_element(key);
-      return m_list.front().second;
+      return {m_list.begin(), true};
+    }
+
+    T& operator[](const Key& key) {
+      return try_emplace(key).first->second;
+    }
+
+    // Pins nest: the element can be evicted again after as many unpins
+    void pin(iterator it) {
+      if (!it->pins++)
+        m_pinned.splice(m_pinned.end(), m_list, it);
+    }
+
+    void unpin(iterator it) {
+      if (!--it->pins)
+        m_list.splice(m_list.begin(), m_pinned, it);
     }
 
     std::size_t size() const {
-      return m_list.size();
+      return m_list.size() + m_pinned.size();
     }
 
     std::size_t capacity() const {
@@ -142,12 +336,32 @@ class LruMap {
 
     void clear() {
       m_list.clear();
+      m_pinned.clear();
       m_map.clear();
     }
 
+    /*
+     * Removes the elements that satisfy the predicate and hands them over
+     * to the caller, who decides when (and in which thread) to free them.
+     */
+    template<class Predicate>
+    List extract_if(Predicate pred) {
+      List extracted(m_list.get_allocator());
+      auto it = m_list.begin();
+      while (it != m_list.end()) {
+        auto current = it++;
+        if (pred(*current)) {
+          m_map.erase(current->first);
+          extracted.splice(extracted.end(), m_list, current);
+        }
+      }
+      return extracted;
+    }
+
   private:
     void touch(iterator it) {
-      m_list.splice(m_list.begin(), m_list, it);
+      if (!it->pins)
+        m_list.splice(m_list.begin(), m_list, it);
     }
 
     void pop_least_recent() {
@@ -161,8 +375,386 @@ class LruMap {
     }
 
     std::size_t m_capacity;
-    List m_list;
+    List m_list, m_pinned;
     HashMap m_map;
 };
 
+/*
+ * Fixed capacity map with CLOCK (second chance) eviction. Entries live
+ * inline in blocks that are never moved, so references and iterators stay
+ * valid until the entry is evicted. Lookups go through an open addressing
+ * index (linear probing, backward shift deletion) that stores the hash
+ * next to the entry position, so most misses never touch an entry. Pinned
+ * entries are passed over by the clock hand.
+ */
+template< class Key,
+          class T,
+          class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key> >
+class ClockMap {
+  public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key,T> value_type;
+    typedef Hash hasher;
+    typedef KeyEqual key_equal;
+
+  private:
+    template<bool is_const>
+    class Iterator {
+      public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename ClockMap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::conditional_t<is_const, const value_type*, value_type*> pointer;
+        typedef std::conditional_t<is_const, const value_type&, value_type&> reference;
+
+        Iterator() : m_map(nullptr), m_index(0) {}
+
+        operator Iterator<true>() const {
+          return Iterator<true>(m_map, m_index);
+        }
+
+        reference operator*() const {
+          return m_map->value_at(m_index);
+        }
+
+        pointer operator->() const {
+          return &m_map->value_at(m_index);
+        }
+
+        Iterator& operator++() {
+          ++m_index;
+          skip_empty();
+          return *this;
+        }
+
+        Iterator operator++(int) {
+          Iterator old = *this;
+          ++(*this);
+          return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+          return m_index == other.m_index;
+        }
+
+        bool operator!=(const Iterator& other) const {
+          return m_index != other.m_index;
+        }
+
+      private:
+        typedef std::conditional_t<is_const, const ClockMap, ClockMap> Map;
+
+        Iterator(Map* map, std::size_t index) : m_map(map), m_index(index) {}
+
+        void skip_empty() {
+          while (m_index < m_map->m_used && !m_map->is_occupied(m_index))
+            ++m_index;
+        }
+
+        Map* m_map;
+        std::size_t m_index;
+
+        friend class ClockMap;
+        template<bool> friend class Iterator;
+    };
+
+  public:
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    ClockMap(
+      std::size_t capacity = 1000000,
+      Hash hash = Hash(),
+      KeyEqual key_equal = KeyEqual()
+    ) :
+      m_capacity(capacity),
+      m_size(0),
+      m_used(0),
+      m_hand(0),
+      m_hash(std::move(hash)),
+      m_key_equal(std::move(key_equal)) {
+      std::size_t number_of_buckets = 16;
+      while (number_of_buckets < capacity + capacity/2)
+        number_of_buckets *= 2;
+      m_buckets.assign(number_of_buckets, Bucket{0, EMPTY});
+      m_mask = number_of_buckets - 1;
+    }
+
+    ClockMap(const ClockMap&) = delete;
+
+    ClockMap& operator=(const ClockMap&) = delete;
+
+    ~ClockMap() {
+      clear();
+    }
+
+    iterator begin() {
+      iterator it(this, 0);
+      it.skip_empty();
+      return it;
+    }
+
+    iterator end() {
+      return iterator(this, m_used);
+    }
+
+    const_iterator begin() const {
+      const_iterator it(this, 0);
+      it.skip_empty();
+      return it;
+    }
+
+    const_iterator end() const {
+      return const_iterator(this, m_used);
+    }
+
+    iterator find(const Key& key) {
+      std::size_t position = find_bucket(key, hash_of(key));
+      if (position == NOT_FOUND)
+        return end();
+      std::uint32_t index = m_buckets[position].entry;
+      m_meta[index].referenced = true;
+      return iterator(this, index);
+    }
+
+    // Lookup that leaves the reference bits untouched
+    const_iterator find(const Key& key) const {
+      std::size_t position = find_bucket(key, hash_of(key));
+      if (position == NOT_FOUND)
+        return end();
+      return const_iterator(this, m_buckets[position].entry);
+    }
+
+    // Inserts a default constructed value if the key is missing
+    std::pair<iterator,bool> try_emplace(const Key& key) {
+      std::uint32_t hash = hash_of(key);
+      std::size_t position = find_bucket(key, hash);
+      if (position != NOT_FOUND) {
+        std::uint32_t index = m_buckets[position].entry;
+        m_meta[index].referenced = true;
+        return {iterator(this, index), false};
+      }
+      if (m_size >= m_capacity) {
+        std::size_t victim = next_victim();
+        if (victim != NOT_FOUND)
+          erase_entry(victim);
+      }
+      return {iterator(this, add_element(key, hash)), true};
+    }
+
+    T& operator[](const Key& key) {
+      return try_emplace(key).first->second;
+    }
+
+    // Pins nest: the entry can be evicted again after as many unpins
+    void pin(iterator it) {
+      ++m_meta[it.m_index].pins;
+    }
+
+    void unpin(iterator it) {
+      --m_meta[it.m_index].pins;
+    }
+
+    std::size_t size() const {
+      return m_size;
+    }
+
+    std::size_t capacity() const {
+      return m_capacity;
+    }
+
+    void clear() {
+      for (std::size_t index = 0; index < m_used; ++index) {
+        if (is_occupied(index))
+          value_at(index).~value_type();
+      }
+      m_buckets.assign(m_buckets.size(), Bucket{0, EMPTY});
+      m_meta.clear();
+      m_free.clear();
+      m_size = m_used = m_hand = 0;
+    }
+
+    /*
+     * Removes the elements that satisfy the predicate and hands them over
+     * to the caller, who decides when (and in which thread) to free them.
+     */
+    template<class Predicate>
+    std::vector<value_type> extract_if(Predicate pred) {
+      std::vector<value_type> extracted;
+      for (std::size_t index = 0; index < m_used; ++index) {
+        if (is_occupied(index) && pred(value_at(index))) {
+          extracted.push_back(std::move(value_at(index)));
+          erase_entry(index);
+        }
+      }
+      return extracted;
+    }
+
+  private:
+    static constexpr std::uint32_t EMPTY = ~std::uint32_t(0);
+    static constexpr std::size_t NOT_FOUND = ~std::size_t(0);
+    static constexpr std::size_t BLOCK_BITS = 12;
+    static constexpr std::size_t BLOCK_SIZE = std::size_t(1) << BLOCK_BITS;
+
+    struct Bucket {
+      std::uint32_t hash, entry;
+    };
+
+    struct Meta {
+      std::uint32_t bucket;
+      std::uint16_t pins;
+      bool referenced;
+    };
+
+    struct Block {
+      alignas(value_type) unsigned char data[BLOCK_SIZE*sizeof(value_type)];
+    };
+
+    std::uint32_t hash_of(const Key& key) const {
+      std::uint64_t h = m_hash(key);
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      return h;
+    }
+
+    bool is_occupied(std::size_t index) const {
+      return m_meta[index].bucket != EMPTY;
+    }
+
+    void* slot_at(std::size_t index) const {
+      auto* data = m_blocks[index >> BLOCK_BITS]->data;
+      return data + (index & (BLOCK_SIZE-1))*sizeof(value_type);
+    }
+
+    value_type& value_at(std::size_t index) {
+      return *std::launder(static_cast<value_type*>(slot_at(index)));
+    }
+
+    const value_type& value_at(std::size_t index) const {
+      return *std::launder(static_cast<const value_type*>(slot_at(index)));
+    }
+
+    std::size_t find_bucket(const Key& key, std::uint32_t hash) const {
+      std::size_t position = hash & m_mask;
+      while (m_buckets[position].entry != EMPTY) {
+        const Bucket& bucket = m_buckets[position];
+        if (bucket.hash == hash && m_key_equal(value_at(bucket.entry).first, key))
+          return position;
+        position = (position + 1) & m_mask;
+      }
+      return NOT_FOUND;
+    }
+
+    // Two sweeps clear every reference bit, so after them only pins remain
+    std::size_t next_victim() {
+      for (std::size_t step = 0; step <= 2*m_used; ++step) {
+        std::size_t index = m_hand;
+        m_hand = m_hand + 1 == m_used? 0 : m_hand + 1;
+        if (!is_occupied(index) || m_meta[index].pins)
+          continue;
+        if (!m_meta[index].referenced)
+          return index;
+        m_meta[index].referenced = false;
+      }
+      return NOT_FOUND;
+    }
+
+    void erase_entry(std::size_t index) {
+      std::size_t hole = m_meta[index].bucket;
+      std::size_t position = (hole + 1) & m_mask;
+      while (m_buckets[position].entry != EMPTY) {
+        std::size_t home = m_buckets[position].hash & m_mask;
+        if (((position - home) & m_mask) >= ((position - hole) & m_mask)) {
+          m_buckets[hole] = m_buckets[position];
+          m_meta[m_buckets[hole].entry].bucket = hole;
+          hole = position;
+        }
+        position = (position + 1) & m_mask;
+      }
+      m_buckets[hole].entry = EMPTY;
+      value_at(index).~value_type();
+      m_meta[index].bucket = EMPTY;
+      m_free.push_back(index);
+      --m_size;
+    }
+
+    std::size_t add_element(const Key& key, std::uint32_t hash) {
+      std::size_t index;
+      if (!m_free.empty()) {
+        index = m_free.back();
+        m_free.pop_back();
+      }
+      else {
+        index = m_used++;
+        if ((index >> BLOCK_BITS) == m_blocks.size())
+          m_blocks.emplace_back(new Block);
+        m_meta.emplace_back();
+      }
+      std::size_t position = hash & m_mask;
+      while (m_buckets[position].entry != EMPTY)
+        position = (position + 1) & m_mask;
+      m_buckets[position] = Bucket{hash, std::uint32_t(index)};
+      m_meta[index] = Meta{std::uint32_t(position), 0, true};
+      ++m_size;
+      new (slot_at(index)) value_type(std::piecewise_construct,
+          std::forward_as_tuple(key), std::forward_as_tuple());
+      return index;
+    }
+
+    std::size_t m_capacity, m_size, m_used, m_hand, m_mask;
+    Hash m_hash;
+    KeyEqual m_key_equal;
+    std::vector<Bucket> m_buckets;
+    std::vector<Meta> m_meta;
+    std::vector<std::uint32_t> m_free;
+    std::vector<std::unique_ptr<Block>> m_blocks;
+};
+
+/*
+ * Whole file mapped read-only into memory, unmapped on destruction.
+ */
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string& path) : m_data(nullptr), m_size(0) {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("cannot open " + path);
+      struct stat file_stat;
+      if (::fstat(fd, &file_stat) < 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path);
+      }
+      m_size = file_stat.st_size;
+      if (m_size)
+        m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (m_data == MAP_FAILED)
+        throw std::runtime_error("cannot map " + path);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+      if (m_size)
+        ::munmap(m_data, m_size);
+    }
+
+    const char* data() const {
+      return static_cast<const char*>(m_data);
+    }
+
+    std::size_t size() const {
+      return m_size;
+    }
+
+  private:
+    void* m_data;
+    std::size_t m_size;
+};
+
 } // mcts::memory
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "mcts.hpp"
+#include "memory_utils.hpp"
+#include "thread_pool.hpp"
+
+namespace mcts {
+
+struct OpeningBookOptions {
+  int depth = 4;  // plies below the initial position
+  int simulations = 50000;  // searched from every position
+  double min_share = 0.25;  // of the visits of the best move, for a move to be followed
+  int max_branching = 3;  // moves followed from every position
+};
+
+/*
+ * Read-only opening book mapped from a binary file: the visit distribution
+ * of the root actions of a deep search for every book position. The file
+ * holds, in native byte order, a header, the positions sorted by state hash
+ * and the moves of all the positions, so a lookup is a binary search on the
+ * mapped file.
+ */
+template<class Environment>
+class OpeningBook {
+  public:
+    typedef State<Environment> StateType;
+    typedef std::function<std::unique_ptr<MctsBase<Environment>>()> AlgorithmFactory;
+
+    struct Move {
+      Action<Environment> action;
+      std::int32_t visits;
+    };
+
+    struct Position {
+      std::uint64_t hash;
+      StateType state;
+      std::uint32_t first_move, number_of_moves;
+      std::int32_t visits, best_move;
+    };
+
+    static_assert(std::is_trivially_copyable_v<StateType>,
+        "opening books need trivially copyable states");
+    static_assert(std::is_trivially_copyable_v<Move>,
+        "opening books need trivially copyable actions");
+
+    static constexpr std::uint32_t VERSION = 1;
+
+    /*
+     * Self-play from the initial position: every position is searched by a
+     * fresh algorithm of the factory, as asynchronous searches that keep
+     * every worker of the pool busy, and the most visited moves are
+     * followed (see OpeningBookOptions) down to the book depth. Finished
+     * positions are reported to the log. The pool needs at least one
+     * worker, since nobody else runs the background searches.
+     */
+    static void build(
+        const std::string& path,
+        multithreading::Pool& pool,
+        const AlgorithmFactory& factory,
+        const OpeningBookOptions& options = OpeningBookOptions(),
+        std::ostream* log = nullptr) {
+      if (!pool.number_of_workers())
+        throw std::invalid_argument("opening books need a pool with workers");
+      const unsigned max_in_flight = std::max(1U, pool.number_of_workers());
+      struct Search {
+        Environment env;
+        std::unique_ptr<MctsBase<Environment>> algorithm;
+        SearchHandle<Environment> handle;
+      };
+      std::vector<Position> positions;
+      std::vector<Move> moves;
+      std::unordered_set<StateType,StateHash<StateType>,StateEqual<StateType>> seen;
+      std::vector<Environment> frontier{Environment()};
+      seen.insert(frontier.front().get_state());
+      for (int ply = 0; ply <= options.depth && !frontier.empty(); ++ply) {
+        std::vector<Environment> next_frontier;
+        std::deque<Search> in_flight;
+        auto finish_oldest = [&] {
+          Search& search = in_flight.front();
+          Action<Environment> action = search.handle.get();
+          auto followed = add_position(positions, moves, search.env, action,
+                                       search.handle.progress(), options);
+          if (log)
+            *log << "ply " << ply << ": " << positions.size() << " positions" << std::endl;
+          for (const auto& child_action : followed) {
+            Environment child = search.env;
+            child.step(child_action);
+            if (ply < options.depth && !child.is_terminal() &&
+                seen.insert(child.get_state()).second)
+              next_frontier.push_back(child);
+          }
+          in_flight.pop_front();
+        };
+        for (const Environment& env : frontier) {
+          if (in_flight.size() >= max_in_flight)
+            finish_oldest();
+          auto algorithm = factory();
+          auto handle = algorithm->search_async(env, pool, -1, options.simulations);
+          in_flight.push_back({env, std::move(algorithm), std::move(handle)});
+        }
+        while (!in_flight.empty())
+          finish_oldest();
+        frontier = std::move(next_frontier);
+      }
+      write(path, std::move(positions), moves);
+    }
+
+    static void write(
+        const std::string& path,
+        std::vector<Position> positions,
+        const std::vector<Move>& moves) {
+      std::sort(positions.begin(), positions.end(),
+          [](const Position& lhs, const Position& rhs) { return lhs.hash < rhs.hash; });
+      Header header = make_header(positions.size(), moves.size());
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+      out.write(reinterpret_cast<const char*>(positions.data()), positions.size()*sizeof(Position));
+      out.write(reinterpret_cast<const char*>(moves.data()), moves.size()*sizeof(Move));
+      if (!out)
+        throw std::runtime_error("cannot write opening book " + path);
+    }
+
+    explicit OpeningBook(const std::string& path) : m_file(path) {
+      if (m_file.size() < sizeof(Header))
+        throw std::runtime_error("invalid opening book " + path);
+      const Header& header = *reinterpret_cast<const Header*>(m_file.data());
+      Header expected = make_header(header.number_of_positions, header.number_of_moves);
+      if (std::memcmp(&header, &expected, sizeof(Header)) ||
+          m_file.size() != sizeof(Header) + header.number_of_positions*sizeof(Position)
+                           + header.number_of_moves*sizeof(Move))
+        throw std::runtime_error("incompatible opening book " + path);
+      m_positions = reinterpret_cast<const Position*>(m_file.data() + sizeof(Header));
+      m_number_of_positions = header.number_of_positions;
+      m_moves = reinterpret_cast<const Move*>(m_positions + m_number_of_positions);
+    }
+
+    const Position* find(const StateType& state) const {
+      std::uint64_t hash = StateHash<StateType>()(state);
+      StateEqual<StateType> equal;
+      const Position* end = m_positions + m_number_of_positions;
+      const Position* it = std::lower_bound(m_positions, end, hash,
+          [](const Position& position, std::uint64_t hash) { return position.hash < hash; });
+      for (; it != end && it->hash == hash; ++it) {
+        if (equal(it->state, state))
+          return it;
+      }
+      return nullptr;
+    }
+
+    const Move* moves(const Position& position) const {
+      return m_moves + position.first_move;
+    }
+
+    const Move& best_move(const Position& position) const {
+      return moves(position)[position.best_move];
+    }
+
+    std::size_t size() const {
+      return m_number_of_positions;
+    }
+
+    std::size_t bytes() const {
+      return m_file.size();
+    }
+
+  private:
+    struct Header {
+      char magic[8];
+      std::uint32_t version, state_size, position_size, move_size;
+      std::uint64_t number_of_positions, number_of_moves;
+    };
+
+    static Header make_header(std::uint64_t number_of_positions, std::uint64_t number_of_moves) {
+      Header header;
+      std::memset(&header, 0, sizeof(Header));
+      std::memcpy(header.magic, "MCTSBOOK", 8);
+      header.version = VERSION;
+      header.state_size = sizeof(StateType);
+      header.position_size = sizeof(Position);
+      header.move_size = sizeof(Move);
+      header.number_of_positions = number_of_positions;
+      header.number_of_moves = number_of_moves;
+      return header;
+    }
+
+    /*
+     * Appends the position searched from env and returns the actions to
+     * follow. Algorithms that do not publish the root actions only give
+     * the chosen action, with all the visits.
+     */
+    static std::vector<Action<Environment>> add_position(
+        std::vector<Position>& positions,
+        std::vector<Move>& moves,
+        const Environment& env,
+        const Action<Environment>& action,
+        const SearchProgress<Environment>& progress,
+        const OpeningBookOptions& options) {
+      Position position;
+      std::memset(&position, 0, sizeof(Position));
+      position.hash = StateHash<StateType>()(env.get_state());
+      position.state = env.get_state();
+      position.first_move = moves.size();
+      std::vector<Move> root_moves;
+      for (const auto& action_info : progress.root_actions) {
+        Move move;
+        std::memset(&move, 0, sizeof(Move));
+        move.action = action_info.action;
+        move.visits = action_info.visits;
+        root_moves.push_back(move);
+      }
+      if (root_moves.empty()) {
+        Move move;
+        std::memset(&move, 0, sizeof(Move));
+        move.action = action;
+        move.visits = progress.number_of_simulations;
+        root_moves.push_back(move);
+      }
+      std::stable_sort(root_moves.begin(), root_moves.end(),
+          [](const Move& lhs, const Move& rhs) { return lhs.visits > rhs.visits; });
+      position.number_of_moves = root_moves.size();
+      for (const Move& move : root_moves)
+        position.visits += move.visits;
+      position.best_move = 0;
+      std::vector<Action<Environment>> followed;
+      for (const Move& move : root_moves) {
+        if (int(followed.size()) < options.max_branching &&
+            move.visits >= options.min_share*root_moves.front().visits)
+          followed.push_back(move.action);
+      }
+      moves.insert(moves.end(), root_moves.begin(), root_moves.end());
+      positions.push_back(position);
+      return followed;
+    }
+
+    memory::MappedFile m_file;
+    const Position* m_positions;
+    std::size_t m_number_of_positions;
+    const Move* m_moves;
+};
+
+/*
+ * Answers the positions of the book with their most visited move, without
+ * searching, and delegates the rest to the wrapped algorithm. Its
+ * statistics are those of the wrapped algorithm, except for the last call
+ * after a book move. Controlled searches that are not book moves only get
+ * their final progress published.
+ */
+template<class Environment>
+class BookSearch : public MctsBase<Environment> {
+  public:
+    BookSearch(
+      std::shared_ptr<const OpeningBook<Environment>> book,
+      std::unique_ptr<MctsBase<Environment>> algorithm
+    ) :
+      m_book(std::move(book)),
+      m_algorithm(std::move(algorithm)),
+      m_book_moves(0) {}
+
+    virtual Action<Environment> search(
+      const Environment& env,
+      std::ostream* log = nullptr,
+      double timeout_s = -1,
+      int simulation_limit = -1
+    ) override {
+      Action<Environment> action;
+      if (book_move(env, log, action))
+        return action;
+      action = m_algorithm->search(env, log, timeout_s, simulation_limit);
+      this->m_statistics = m_algorithm->get_statistics();
+      return action;
+    }
+
+    virtual void reset() override {
+      m_algorithm->reset();
+    }
+
+    virtual std::size_t reroot(
+      const Environment& env,
+      multithreading::Pool* pool = nullptr
+    ) override {
+      return m_algorithm->reroot(env, pool);
+    }
+
+    virtual void ponder(const Environment& env, multithreading::Pool& pool) override {
+      m_algorithm->ponder(env, pool);
+    }
+
+    virtual std::size_t stop_pondering(
+      const Environment& env,
+      multithreading::Pool* pool = nullptr
+    ) override {
+      return m_algorithm->stop_pondering(env, pool);
+    }
+
+    int book_moves() const {
+      return m_book_moves;
+    }
+
+  protected:
+    virtual Action<Environment> controlled_search(
+      const Environment& env,
+      double timeout_s,
+      int simulation_limit,
+      SearchControl<Environment>& control
+    ) override {
+      Action<Environment> action;
+      if (book_move(env, nullptr, action)) {
+        SearchProgress<Environment> progress;
+        progress.elapsed = this->m_statistics.elapsed_last_call;
+        control.publish(std::move(progress));
+        return action;
+      }
+      return MctsBase<Environment>::controlled_search(env, timeout_s, simulation_limit, control);
+    }
+
+  private:
+    bool book_move(const Environment& env, std::ostream* log, Action<Environment>& action) {
+      using namespace std::chrono;
+      auto start = steady_clock::now();
+      const auto* position = m_book->find(env.get_state());
+      if (!position)
+        return false;
+      const auto& move = m_book->best_move(*position);
+      action = move.action;
+      ++m_book_moves;
+      duration<double> elapsed = steady_clock::now() - start;
+      this->m_statistics.elapsed_last_call = elapsed.count();
+      this->m_statistics.number_of_simulations_last = 0;
+      this->m_statistics.time_per_simulation_last = 0;
+      if (log) {
+        *log << "Book move " << action << " (" << move.visits << '/' << position->visits
+             << " visits)" << std::endl;
+      }
+      return true;
+    }
+
+    std::shared_ptr<const OpeningBook<Environment>> m_book;
+    std::unique_ptr<MctsBase<Environment>> m_algorithm;
+    int m_book_moves;
+};
+
+} // mcts
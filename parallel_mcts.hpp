@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "mcts.hpp"
+#include "thread_pool.hpp"
+
+namespace mcts {
+
+/*
+ * Node decorator that keeps track of the simulations that are currently
+ * running through each action. Pending simulations are counted as returns
+ * of 0 (a loss in the games of this framework), which steers concurrent
+ * workers towards different branches of the shared tree. They only enter
+ * the selection scores; the visit counts used by the backups are left
+ * alone.
+ */
+template<class Node>
+struct VirtualLossNode : Node {
+  std::vector<int> virtual_losses;
+  int virtual_visits;
+
+  double get_action_value(int action_index) const {
+    double value = Node::get_action_value(action_index);
+    int virtual_loss = virtual_losses[action_index];
+    if (!virtual_loss)
+      return value;
+    int visits = this->action_vector[action_index].visits;
+    return value*visits/(visits + virtual_loss);
+  }
+
+  int selection_visits() const {
+    return this->visits + virtual_visits;
+  }
+
+  int selection_visits(int action_index) const {
+    return this->action_vector[action_index].visits + virtual_losses[action_index];
+  }
+
+  template<class Environment>
+  void init(const Environment& environment) {
+    Node::init(environment);
+    virtual_losses.assign(this->action_vector.size(), 0);
+    virtual_visits = 0;
+  }
+
+  void add_virtual_loss(int action_index, int amount) {
+    virtual_visits += amount;
+    virtual_losses[action_index] += amount;
+  }
+};
+
+/*
+ * Tree parallelization: every worker runs complete simulations against a
+ * single shared tree. Selection, expansion and backup are serialized by a
+ * mutex while the rollouts, which dominate the cost of a simulation, run
+ * concurrently. There must be one default policy per worker because
+ * policies usually own a random number generator.
+ */
+template< class Environment,
+          class Select,
+          class DefaultPolicy,
+          class Backup >
+class TreeParallelMcts : public MctsBase<Environment> {
+  public:
+    TreeParallelMcts(
+      Select select,
+      std::vector<DefaultPolicy> default_policies,
+      Backup backup,
+      int memory_capacity = 300000,
+      int virtual_loss = 1
+    ) :
+      m_select(std::move(select)),
+      m_default_policies(std::move(default_policies)),
+      m_backup(std::move(backup)),
+      m_memory(memory_capacity),
+      m_virtual_loss(virtual_loss),
+      m_pool(m_default_policies.size()) {}
+
+    virtual Action<Environment> search(
+      const Environment& env,
+      std::ostream* log = nullptr,
+      double timeout_s = -1,
+      int simulation_limit = -1
+    ) override {
+      using namespace std::chrono;
+      if (timeout_s < 0)
+        timeout_s = std::numeric_limits<double>::infinity();
+      if (simulation_limit < 0)
+        simulation_limit = std::numeric_limits<int>::max();
+      duration<double> timeout(timeout_s);
+      auto start = steady_clock::now();
+      std::atomic<int> tickets(0);
+      multithreading::TaskGroup workers(m_pool);
+      for (auto& default_policy : m_default_policies) {
+        workers.run([&] {
+          work(env, default_policy, tickets, simulation_limit, start, timeout);
+        });
+      }
+      workers.wait();
+      duration<double> elapsed = steady_clock::now() - start;
+      int number_of_simulations = std::min(tickets.load(), simulation_limit);
+      this->m_statistics.update(number_of_simulations, elapsed.count());
+      MostVisitedSelect select;
+      const Node& root = m_memory.find(env.get_state())->second;
+      int argmax = select(root);
+      if (log) {
+        *log << this->m_statistics << "\n\n"
+             << "Current node\n"
+             << "------------\n"
+             << root << '\n'
+             << "Memory usage\n"
+             << "------------\n"
+             << m_memory.size();
+      }
+      return root.action_vector[argmax].action;
+    }
+
+    virtual void reset() override {
+      m_memory.clear();
+    }
+
+    virtual std::size_t reroot(
+      const Environment& env,
+      multithreading::Pool* pool = nullptr
+    ) override {
+      return retain_subtree(m_memory, env, pool);
+    }
+
+    unsigned number_of_threads() const {
+      return m_default_policies.size();
+    }
+
+  private:
+    typedef VirtualLossNode<typename Backup::Node> Node;
+    typedef memory::LruMap<State<Environment>,Node,
+                           StateHash<State<Environment>>,StateEqual<State<Environment>>> MemoryType;
+    typedef TreePath<typename MemoryType::iterator> Path;
+
+    void work(
+      const Environment& env,
+      DefaultPolicy& default_policy,
+      std::atomic<int>& tickets,
+      int simulation_limit,
+      std::chrono::steady_clock::time_point start,
+      std::chrono::duration<double> timeout
+    ) {
+      using namespace std::chrono;
+      // scratch buffers of this worker, reused by all its passes
+      Path tree_path;
+      RewardVector<Environment> rewards;
+      while (tickets.fetch_add(1, std::memory_order_relaxed) < simulation_limit) {
+        tree_path.clear();
+        rewards.clear();
+        single_pass(env, default_policy, tree_path, rewards);
+        if (steady_clock::now() - start >= timeout)
+          break;
+      }
+    }
+
+    void single_pass(
+      Environment sandbox,
+      DefaultPolicy& default_policy,
+      Path& tree_path,
+      RewardVector<Environment>& rewards
+    ) {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        tree_sim(sandbox, tree_path, rewards);
+      }
+      default_sim(sandbox, rewards, default_policy);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (const auto& step : tree_path)
+        step.node().add_virtual_loss(step.action_index, -m_virtual_loss);
+      m_backup(tree_path, rewards);
+      for (const auto& step : tree_path)
+        m_memory.unpin(step.handle);
+      this->m_statistics.update_episode_length(sandbox.get_turn());
+    }
+
+    // Nodes are pinned as they enter the path, so the handles stay valid
+    // while other workers expand (and evict) nodes
+    void tree_sim(
+      Environment& sandbox,
+      Path& tree_path,
+      RewardVector<Environment>& rewards
+    ) {
+      bool leaf_or_terminal = sandbox.is_terminal();
+      while (!leaf_or_terminal) {
+        auto[it, inserted] = m_memory.try_emplace(sandbox.get_state());
+        Node& node = it->second;
+        if (inserted) {
+          node.init(sandbox);
+          leaf_or_terminal = true;
+        }
+        m_memory.pin(it);
+        int selected = m_select(node);
+        node.add_virtual_loss(selected, m_virtual_loss);
+        tree_path.push_back({it, selected});
+        rewards.push_back(sandbox.step(node.action_vector[selected].action));
+        leaf_or_terminal = leaf_or_terminal || sandbox.is_terminal();
+      }
+    }
+
+    void default_sim(
+      Environment& sandbox,
+      RewardVector<Environment>& rewards,
+      DefaultPolicy& default_policy
+    ) {
+      if constexpr (is_leaf_evaluator_v<DefaultPolicy,Environment>) {
+        if (!sandbox.is_terminal())
+          rewards.push_back(default_policy.evaluate(sandbox, m_backup.discount));
+      }
+      else {
+        ActionList<Environment> available_actions;
+        while (!sandbox.is_terminal()) {
+          fill_available_actions(sandbox, available_actions);
+          int selected = default_policy(sandbox, available_actions);
+          rewards.push_back(sandbox.step(available_actions[selected]));
+        }
+      }
+    }
+
+    Select m_select;
+    std::vector<DefaultPolicy> m_default_policies;
+    Backup m_backup;
+    MemoryType m_memory;
+    int m_virtual_loss;
+    std::mutex m_mutex;
+    multithreading::Pool m_pool;
+};
+
+/*
+ * Root parallelization: an ensemble of independent Mcts instances searches
+ * the same position concurrently, each one with its own default policy and
+ * memory. The root statistics of all the members are merged afterwards
+ * (visits are added up, returns are averaged weighting them by visits) and
+ * the most visited action of the merged root is returned.
+ */
+template< class Environment,
+          class Select,
+          class DefaultPolicy,
+          class Backup >
+class RootParallelMcts : public MctsBase<Environment> {
+  public:
+    typedef Mcts<Environment,Select,DefaultPolicy,Backup> Member;
+    typedef NodeBase<ActionInfoBase<Environment>> MergedNode;
+
+    // merge_roots needs every member root to hold all the actions, in order
+    static_assert(!IsWideningNode<typename Backup::Node>::value,
+        "root parallelization does not support progressive widening");
+
+    RootParallelMcts(
+      Select select,
+      std::vector<DefaultPolicy> default_policies,
+      Backup backup,
+      int memory_capacity = 300000
+    ) :
+      m_pool(default_policies.size()) {
+      m_members.reserve(default_policies.size());
+      for (auto& default_policy : default_policies) {
+        m_members.push_back(std::make_unique<Member>(
+              select, std::move(default_policy), backup, memory_capacity));
+      }
+    }
+
+    virtual Action<Environment> search(
+      const Environment& env,
+      std::ostream* log = nullptr,
+      double timeout_s = -1,
+      int simulation_limit = -1
+    ) override {
+      using namespace std::chrono;
+      // The simulations are split as evenly as possible: the first
+      // simulation_limit % ensemble_size members run one more than the
+      // others. Members left without any simulation sit the search out.
+      int ensemble_size = m_members.size();
+      int number_of_members = ensemble_size;
+      if (simulation_limit >= 0)
+        number_of_members = std::clamp(simulation_limit, 1, ensemble_size);
+      auto start = steady_clock::now();
+      multithreading::TaskGroup searches(m_pool);
+      for (int i = 0; i < number_of_members; ++i) {
+        int member_limit = simulation_limit;
+        if (simulation_limit >= 0)
+          member_limit = simulation_limit/ensemble_size + (i < simulation_limit%ensemble_size);
+        searches.run([&, i, member_limit] {
+          m_members[i]->search(env, nullptr, timeout_s, member_limit);
+        });
+      }
+      searches.wait();
+      duration<double> elapsed = steady_clock::now() - start;
+      int number_of_simulations = 0;
+      for (int i = 0; i < number_of_members; ++i) {
+        const auto& member_stats = m_members[i]->get_statistics();
+        number_of_simulations += member_stats.number_of_simulations_last;
+        this->m_statistics.update_episode_length(member_stats.max_episode_length);
+      }
+      this->m_statistics.update(number_of_simulations, elapsed.count());
+      MergedNode root = merge_roots(env, number_of_members);
+      MostVisitedSelect select;
+      int argmax = select(root);
+      if (log) {
+        std::size_t memory_usage = 0;
+        for (const auto& member : m_members)
+          memory_usage += member->memory_usage();
+        *log << this->m_statistics << "\n\n"
+             << "Current node (merged)\n"
+             << "---------------------\n"
+             << root << '\n'
+             << "Memory usage\n"
+             << "------------\n"
+             << memory_usage;
+      }
+      return root.action_vector[argmax].action;
+    }
+
+    virtual void reset() override {
+      for (auto& member : m_members)
+        member->reset();
+    }
+
+    virtual std::size_t reroot(
+      const Environment& env,
+      multithreading::Pool* pool = nullptr
+    ) override {
+      std::size_t number_of_freed = 0;
+      for (auto& member : m_members)
+        number_of_freed += member->reroot(env, pool);
+      return number_of_freed;
+    }
+
+    unsigned ensemble_size() const {
+      return m_members.size();
+    }
+
+  private:
+    // Merges the roots of the first number_of_members members
+    MergedNode merge_roots(const Environment& env, int number_of_members) const {
+      MergedNode merged;
+      merged.init(env);
+      for (int m = 0; m < number_of_members; ++m) {
+        const auto& root = *m_members[m]->find_node(env.get_state());
+        merged.visits += root.visits;
+        for (unsigned i = 0; i < merged.action_vector.size(); ++i) {
+          auto& merged_info = merged.action_vector[i];
+          const auto& member_info = root.action_vector[i];
+          merged_info.visits += member_info.visits;
+          if (merged_info.visits) {
+            double weight = double(member_info.visits)/merged_info.visits;
+            merged_info.expected_return +=
+              weight*(member_info.expected_return - merged_info.expected_return);
+          }
+        }
+      }
+      return merged;
+    }
+
+    std::vector<std::unique_ptr<Member>> m_members;
+    multithreading::Pool m_pool;
+};
+
+} // mcts
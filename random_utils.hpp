@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace mcts {
+
+/*
+ * Sampling helpers with fast paths for generators whose outputs cover all
+ * the 32 or 64 bits (such as the ones of better_rand.hpp, std::mt19937 and
+ * std::mt19937_64): unlike the standard distributions they keep no state,
+ * so they cost nothing to set up on every call. Any other uniform random
+ * bit generator (std::minstd_rand, std::ranlux24...) goes through the
+ * standard distributions.
+ */
+template<class Random>
+inline constexpr bool is_full_range_random_v =
+  Random::min() == 0 &&
+  (Random::max() == std::numeric_limits<std::uint32_t>::max() ||
+   Random::max() == std::numeric_limits<std::uint64_t>::max());
+
+// 32 random bits (the high ones of 64 bit generators)
+template<class Random>
+inline std::uint32_t random_bits32(Random& rng) {
+  static_assert(is_full_range_random_v<Random>, "the generator must give 32 or 64 full bits");
+  if constexpr (Random::max() == std::numeric_limits<std::uint32_t>::max())
+    return rng();
+  else
+    return rng() >> 32;
+}
+
+/*
+ * Uniform integer in [0, range), range > 0. Lemire's nearly divisionless
+ * method: the high half of random*range, rejecting the few low halves that
+ * would bias it. The division only happens when the low half falls below
+ * range, which for the small ranges of the action lists is almost never.
+ */
+template<class Random>
+inline std::uint32_t bounded_random(Random& rng, std::uint32_t range) {
+  if constexpr (is_full_range_random_v<Random>) {
+    std::uint64_t product = std::uint64_t(random_bits32(rng))*range;
+    std::uint32_t low = product;
+    if (low < range) {
+      std::uint32_t threshold = -range % range;
+      while (low < threshold) {
+        product = std::uint64_t(random_bits32(rng))*range;
+        low = product;
+      }
+    }
+    return product >> 32;
+  }
+  else
+    return std::uniform_int_distribution<std::uint32_t>(0, range - 1)(rng);
+}
+
+// Uniform double in [0, 1), with all the bits of the mantissa that the
+// generator can fill
+template<class Random>
+inline double random_real(Random& rng) {
+  if constexpr (!is_full_range_random_v<Random>)
+    return std::generate_canonical<double,std::numeric_limits<double>::digits>(rng);
+  else if constexpr (Random::max() == std::numeric_limits<std::uint32_t>::max())
+    return rng()*0x1p-32;
+  else
+    return (rng() >> 11)*0x1p-53;
+}
+
+/*
+ * 32 bit generator that draws the outputs of the wrapped one in bulk, N at
+ * a time, and hands them out from the buffer. Refilling in a tight loop
+ * lets the compiler overlap the steps of the generator, and both halves of
+ * the outputs of 64 bit generators are used. It is a generator itself, so
+ * the helpers above take it.
+ */
+template<class Random, std::size_t N = 256>
+class RandomBuffer {
+  public:
+    typedef std::uint32_t result_type;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    explicit RandomBuffer(Random rng = Random()) :
+      m_rng(std::move(rng)),
+      m_next(N) {}
+
+    result_type operator()() {
+      if (m_next == N)
+        refill();
+      return m_buffer[m_next++];
+    }
+
+    // The generator, which is ahead of the draws by the buffered outputs
+    Random& generator() {
+      return m_rng;
+    }
+
+  private:
+    static_assert(is_full_range_random_v<Random>, "the generator must give 32 or 64 full bits");
+    static_assert(N % 2 == 0, "the buffer takes the outputs of 64 bit generators in halves");
+
+    void refill() {
+      if constexpr (Random::max() == std::numeric_limits<std::uint32_t>::max()) {
+        for (result_type& value : m_buffer)
+          value = m_rng();
+      }
+      else {
+        for (std::size_t i = 0; i < N; i += 2) {
+          std::uint64_t value = m_rng();
+          m_buffer[i] = value >> 32;
+          m_buffer[i + 1] = value;
+        }
+      }
+      m_next = 0;
+    }
+
+    Random m_rng;
+    std::array<result_type,N> m_buffer;
+    std::size_t m_next;
+};
+
+/*
+ * Generators for number_of_streams parallel workers whose sequences do not
+ * overlap: the first one is rng and every other one is the previous one
+ * after a jump() (see pcg32 and xoshiro256ss in better_rand.hpp).
+ */
+template<class Random>
+std::vector<Random> split_streams(Random rng, unsigned number_of_streams) {
+  std::vector<Random> streams;
+  streams.reserve(number_of_streams);
+  for (unsigned i = 0; i < number_of_streams; ++i) {
+    streams.push_back(rng);
+    rng.jump();
+  }
+  return streams;
+}
+
+} // mcts
@@ -2,16 +2,42 @@
 
 #include <cmath>
 #include <limits>
-#include <random>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
 #include "common.hpp"
+#include "random_utils.hpp"
+#include "simd_select.hpp"
 
 namespace mcts {
 
+// Nodes whose statistics are laid out for the SIMD argmax kernels
+template<class Node>
+inline constexpr bool has_soa_statistics_v = std::is_same_v<Node,
+  NodeBase<typename Node::ActionInfoType,
+           SoaActionStorage<typename Node::ActionInfoType>>>;
+
+template<class Node>
+const double* soa_values(const Node& node) {
+  return node.action_vector.expected_returns[0].data() + node.maximizing_player;
+}
+
+template<class Node>
+constexpr std::size_t soa_value_stride() {
+  typedef typename Node::ActionStorageType::RewardType RewardType;
+  return std::tuple_size<RewardType>::value;
+}
+
 struct GreedySelect {
   template<class Node>
   int operator()(const Node& node) const {
+    if constexpr (has_soa_statistics_v<Node>) {
+      if (node.action_vector.empty())
+        return -1;
+      return simd::value_argmax(soa_values(node), soa_value_stride<Node>(),
+          node.action_vector.size());
+    }
     int argmax = -1;
     double max = -std::numeric_limits<double>::infinity();
     for (unsigned i = 0; i < node.action_vector.size(); ++i) {
@@ -28,6 +54,10 @@ struct GreedySelect {
 struct MostVisitedSelect {
   template<class Node>
   int operator()(const Node& node) const {
+    if constexpr (has_soa_statistics_v<Node>) {
+      return simd::visits_argmax(node.action_vector.visits.data(),
+          node.action_vector.size());
+    }
     int argmax = -1;
     int max = -1;
     for (unsigned i = 0; i < node.action_vector.size(); ++i) {
@@ -52,12 +82,9 @@ struct EpsilonGreedySelect {
 
   template<class Node>
   int operator()(const Node& node) const {
-    std::uniform_real_distribution<> unif_real(0,1);
     double epsilon = epsilon0 / (1 + decay*node.visits);
-    if (unif_real(*rng) < epsilon) {
-      std::uniform_int_distribution<> unif_int(0,node.action_vector.size()-1);
-      return unif_int(*rng);
-    }
+    if (random_real(*rng) < epsilon)
+      return bounded_random(*rng, node.action_vector.size());
     GreedySelect greedy_select;
     return greedy_select(node);
   }
@@ -70,14 +97,57 @@ struct UctSelect {
 
   template<class Node>
   int operator()(const Node& node) const {
+    double log_visits = std::log(node.selection_visits());
+    if constexpr (has_soa_statistics_v<Node>) {
+      if (node.action_vector.empty())
+        return -1;
+      return simd::uct_argmax(soa_values(node), soa_value_stride<Node>(),
+          node.action_vector.visits.data(), node.action_vector.size(), c, log_visits);
+    }
     double max = -std::numeric_limits<double>::infinity();
     int argmax = -1;
     for (unsigned i = 0; i < node.action_vector.size(); ++i) {
-      const auto& action_info = node.action_vector[i];
-      if (not action_info.visits)
+      int visits = node.selection_visits(i);
+      if (not visits)
         return i;
       double score = node.get_action_value(i) +
-        c*std::sqrt(std::log(node.visits)/action_info.visits);
+        c*std::sqrt(log_visits/visits);
+      if (score > max) {
+        max = score;
+        argmax = i;
+      }
+    }
+    return argmax;
+  }
+};
+
+/*
+ * UCT on values that blend the value of every action with its AMAF value
+ * (see RaveBackup), trusting the AMAF values less as the node gets visits,
+ * with beta = sqrt(equivalence/(3*visits + equivalence)) as weight (Gelly
+ * and Silver). Actions without visits are valued by their AMAF value alone
+ * and, if they have no AMAF visits either, tried first.
+ */
+struct RaveSelect {
+  double c, equivalence;
+
+  RaveSelect(double c, double equivalence = 1000) : c(c), equivalence(equivalence) {}
+
+  template<class Node>
+  int operator()(const Node& node) const {
+    double log_visits = std::log(node.selection_visits());
+    double beta = std::sqrt(equivalence/(3*node.visits + equivalence));
+    double max = -std::numeric_limits<double>::infinity();
+    int argmax = -1;
+    for (unsigned i = 0; i < node.action_vector.size(); ++i) {
+      const auto& action_info = node.action_vector[i];
+      int visits = node.selection_visits(i);
+      if (!visits && !action_info.amaf_visits)
+        return i;
+      double amaf_value = action_info.amaf_return[node.maximizing_player];
+      double value = visits?
+        (1 - beta)*node.get_action_value(i) + beta*amaf_value : amaf_value;
+      double score = value + c*std::sqrt(log_visits/(visits + 1));
       if (score > max) {
         max = score;
         argmax = i;
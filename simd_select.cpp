@@ -0,0 +1,218 @@
+#include <cmath>
+#include <limits>
+
+#include "simd_select.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MCTS_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace mcts::simd {
+
+namespace {
+
+const double MINUS_INF = -std::numeric_limits<double>::infinity();
+
+int uct_argmax_scalar(
+    const double* values,
+    std::size_t stride,
+    const int* visits,
+    int begin,
+    int n,
+    double c,
+    double log_visits,
+    int argmax,
+    double max) {
+  for (int i = begin; i < n; ++i) {
+    if (!visits[i])
+      return i;
+    double score = values[i*stride] + c*std::sqrt(log_visits/visits[i]);
+    if (score > max) {
+      max = score;
+      argmax = i;
+    }
+  }
+  return argmax;
+}
+
+int value_argmax_scalar(
+    const double* values,
+    std::size_t stride,
+    int begin,
+    int n,
+    int argmax,
+    double max) {
+  for (int i = begin; i < n; ++i) {
+    if (values[i*stride] > max) {
+      max = values[i*stride];
+      argmax = i;
+    }
+  }
+  return argmax;
+}
+
+int visits_argmax_scalar(const int* visits, int begin, int n, int argmax, int max) {
+  for (int i = begin; i < n; ++i) {
+    if (visits[i] > max) {
+      max = visits[i];
+      argmax = i;
+    }
+  }
+  return argmax;
+}
+
+#ifdef MCTS_SIMD_X86
+
+// Reduces per lane maximums, preferring the lowest index on ties. Kept
+// inline: an out of line call costs more than the whole kernel on small nodes.
+__attribute__((target("avx2"), always_inline)) inline
+void reduce_lanes(__m256d best, __m256d best_index, int& argmax, double& max) {
+  alignas(32) double lane_max[4], lane_index[4];
+  _mm256_store_pd(lane_max, best);
+  _mm256_store_pd(lane_index, best_index);
+  for (int lane = 0; lane < 4; ++lane) {
+    if (lane_index[lane] < 0)
+      continue;
+    if (lane_max[lane] > max || (lane_max[lane] == max && lane_index[lane] < argmax)) {
+      max = lane_max[lane];
+      argmax = lane_index[lane];
+    }
+  }
+}
+
+// Plain lane loads; vgatherdpd is microcoded (and much slower) on many CPUs
+__attribute__((target("avx2"), always_inline)) inline
+__m256d load_values(const double* values, std::size_t stride) {
+  return _mm256_setr_pd(values[0], values[stride], values[2*stride], values[3*stride]);
+}
+
+__attribute__((target("avx2")))
+int uct_argmax_avx2(
+    const double* values,
+    std::size_t stride,
+    const int* visits,
+    int n,
+    double c,
+    double log_visits) {
+  const __m256d vc = _mm256_set1_pd(c);
+  const __m256d vlog = _mm256_set1_pd(log_visits);
+  const __m256d four = _mm256_set1_pd(4);
+  const __m128i zero = _mm_setzero_si128();
+  __m256d best = _mm256_set1_pd(MINUS_INF);
+  __m256d best_index = _mm256_set1_pd(-1);
+  __m256d index = _mm256_setr_pd(0, 1, 2, 3);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i block_visits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(visits + i));
+    int unvisited = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block_visits, zero)));
+    if (unvisited)
+      return i + __builtin_ctz(unvisited);
+    __m256d exploration = _mm256_sqrt_pd(
+        _mm256_div_pd(vlog, _mm256_cvtepi32_pd(block_visits)));
+    __m256d score = _mm256_add_pd(
+        load_values(values + i*stride, stride), _mm256_mul_pd(vc, exploration));
+    __m256d greater = _mm256_cmp_pd(score, best, _CMP_GT_OQ);
+    best = _mm256_blendv_pd(best, score, greater);
+    best_index = _mm256_blendv_pd(best_index, index, greater);
+    index = _mm256_add_pd(index, four);
+  }
+  int argmax = -1;
+  double max = MINUS_INF;
+  reduce_lanes(best, best_index, argmax, max);
+  return uct_argmax_scalar(values, stride, visits, i, n, c, log_visits, argmax, max);
+}
+
+__attribute__((target("avx2")))
+int value_argmax_avx2(const double* values, std::size_t stride, int n) {
+  const __m256d four = _mm256_set1_pd(4);
+  __m256d best = _mm256_set1_pd(MINUS_INF);
+  __m256d best_index = _mm256_set1_pd(-1);
+  __m256d index = _mm256_setr_pd(0, 1, 2, 3);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d value = load_values(values + i*stride, stride);
+    __m256d greater = _mm256_cmp_pd(value, best, _CMP_GT_OQ);
+    best = _mm256_blendv_pd(best, value, greater);
+    best_index = _mm256_blendv_pd(best_index, index, greater);
+    index = _mm256_add_pd(index, four);
+  }
+  int argmax = -1;
+  double max = MINUS_INF;
+  reduce_lanes(best, best_index, argmax, max);
+  return value_argmax_scalar(values, stride, i, n, argmax, max);
+}
+
+__attribute__((target("avx2")))
+int visits_argmax_avx2(const int* visits, int n) {
+  const __m256i eight = _mm256_set1_epi32(8);
+  __m256i best = _mm256_set1_epi32(-1);
+  __m256i best_index = _mm256_set1_epi32(-1);
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(visits + i));
+    __m256i greater = _mm256_cmpgt_epi32(block, best);
+    best = _mm256_blendv_epi8(best, block, greater);
+    best_index = _mm256_blendv_epi8(best_index, index, greater);
+    index = _mm256_add_epi32(index, eight);
+  }
+  alignas(32) int lane_max[8], lane_index[8];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lane_max), best);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lane_index), best_index);
+  int argmax = -1, max = -1;
+  for (int lane = 0; lane < 8; ++lane) {
+    if (lane_index[lane] < 0)
+      continue;
+    if (lane_max[lane] > max || (lane_max[lane] == max && lane_index[lane] < argmax)) {
+      max = lane_max[lane];
+      argmax = lane_index[lane];
+    }
+  }
+  return visits_argmax_scalar(visits, i, n, argmax, max);
+}
+
+#endif
+
+} // anonymous ns
+
+bool avx2_enabled() {
+#ifdef MCTS_SIMD_X86
+  static const bool enabled = __builtin_cpu_supports("avx2");
+  return enabled;
+#else
+  return false;
+#endif
+}
+
+int uct_argmax(
+    const double* values,
+    std::size_t stride,
+    const int* visits,
+    int n,
+    double c,
+    double log_visits) {
+#ifdef MCTS_SIMD_X86
+  if (avx2_enabled())
+    return uct_argmax_avx2(values, stride, visits, n, c, log_visits);
+#endif
+  return uct_argmax_scalar(values, stride, visits, 0, n, c, log_visits, -1, MINUS_INF);
+}
+
+int value_argmax(const double* values, std::size_t stride, int n) {
+#ifdef MCTS_SIMD_X86
+  if (avx2_enabled())
+    return value_argmax_avx2(values, stride, n);
+#endif
+  return value_argmax_scalar(values, stride, 0, n, -1, MINUS_INF);
+}
+
+int visits_argmax(const int* visits, int n) {
+#ifdef MCTS_SIMD_X86
+  if (avx2_enabled())
+    return visits_argmax_avx2(visits, n);
+#endif
+  return visits_argmax_scalar(visits, 0, n, -1, -1);
+}
+
+} // mcts::simd
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mcts::simd {
+
+/*
+ * Argmax kernels over struct of arrays node statistics. The value of action
+ * i is values[i*stride] and its visit count is visits[i]. All of them
+ * return the first index among the maximums (or -1 if n is 0), exactly as
+ * the scalar selectors do. An AVX2 implementation is used when the CPU
+ * supports it, with a portable fallback otherwise.
+ */
+
+// First unvisited action or, if none, argmax of value + c*sqrt(log_visits/visits)
+int uct_argmax(
+    const double* values,
+    std::size_t stride,
+    const int* visits,
+    int n,
+    double c,
+    double log_visits);
+
+int value_argmax(const double* values, std::size_t stride, int n);
+
+int visits_argmax(const int* visits, int n);
+
+bool avx2_enabled();
+
+} // mcts::simd
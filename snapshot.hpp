@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common.hpp"
+#include "memory_utils.hpp"
+
+namespace mcts {
+
+/*
+ * Read-only snapshot of a search memory, mapped from a binary file. The
+ * file holds, in native byte order: a header, an open addressing table of
+ * entry indices by state hash, the entries (state, node visits and the
+ * range of their actions) and the statistics of all the actions. Every
+ * part is trivially copyable and 8 byte aligned, so the mapped file is used
+ * in place. Update methods that keep more than ActionInfoBase (such as the
+ * windows of RunningAverage) only get the base statistics stored.
+ */
+template<class Environment>
+class Snapshot {
+  public:
+    typedef State<Environment> StateType;
+    typedef ActionInfoBase<Environment> ActionRecord;
+
+    static_assert(std::is_trivially_copyable_v<StateType>,
+        "snapshots need trivially copyable states");
+    static_assert(std::is_trivially_copyable_v<ActionRecord>,
+        "snapshots need trivially copyable actions and rewards");
+    static_assert(alignof(StateType) <= 8 && alignof(ActionRecord) <= 8,
+        "snapshot records must not need more than 8 byte alignment");
+
+    // Padded to a multiple of 8 bytes, so the actions after the entries
+    // stay aligned
+    struct alignas(8) Entry {
+      StateType state;
+      std::int32_t visits, maximizing_player;
+      std::uint32_t first_action, number_of_actions;
+    };
+
+    static_assert(sizeof(Entry) % alignof(ActionRecord) == 0,
+        "the actions after the entries would be misaligned");
+
+    static constexpr std::uint32_t VERSION = 1;
+
+    /*
+     * Writes every node of memory (a map from states to nodes that can be
+     * iterated, such as LruMap or ClockMap) to path.
+     */
+    template<class Memory>
+    static void write(const std::string& path, const Memory& memory) {
+      std::vector<Entry> entries;
+      std::vector<ActionRecord> actions;
+      for (const auto& item : memory) {
+        const auto& node = item.second;
+        Entry entry;
+        std::memset(&entry, 0, sizeof(Entry));
+        entry.state = item.first;
+        entry.visits = node.visits;
+        entry.maximizing_player = node.maximizing_player;
+        entry.first_action = actions.size();
+        entry.number_of_actions = node.action_vector.size();
+        entries.push_back(entry);
+        for (unsigned i = 0; i < node.action_vector.size(); ++i) {
+          ActionRecord record;
+          record.expected_return = node.action_vector[i].expected_return;
+          record.action = node.action_vector[i].action;
+          record.visits = node.action_vector[i].visits;
+          actions.push_back(record);
+        }
+      }
+      // at most half full, so the probes stay short
+      std::uint64_t table_size = 1;
+      while (table_size < 2*entries.size())
+        table_size *= 2;
+      std::vector<std::uint32_t> table(table_size + table_size%2, 0);
+      StateHash<StateType> hash;
+      for (std::uint32_t i = 0; i < entries.size(); ++i) {
+        std::uint64_t slot = hash(entries[i].state) & (table_size - 1);
+        while (table[slot])
+          slot = (slot + 1) & (table_size - 1);
+        table[slot] = i + 1;
+      }
+      Header header = make_header(entries.size(), actions.size(), table_size);
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+      out.write(reinterpret_cast<const char*>(table.data()), table.size()*sizeof(std::uint32_t));
+      out.write(reinterpret_cast<const char*>(entries.data()), entries.size()*sizeof(Entry));
+      out.write(reinterpret_cast<const char*>(actions.data()), actions.size()*sizeof(ActionRecord));
+      if (!out)
+        throw std::runtime_error("cannot write snapshot " + path);
+    }
+
+    explicit Snapshot(const std::string& path) : m_file(path) {
+      if (m_file.size() < sizeof(Header))
+        throw std::runtime_error("invalid snapshot " + path);
+      const Header& header = *reinterpret_cast<const Header*>(m_file.data());
+      // find uses the table size as a mask and stops at the first free
+      // slot; the counts are bounded by the file size so that file_size
+      // cannot overflow
+      bool power_of_two = header.table_size && !(header.table_size & (header.table_size - 1));
+      if (!power_of_two || header.number_of_entries >= header.table_size ||
+          header.table_size > m_file.size()/sizeof(std::uint32_t) ||
+          header.number_of_actions > m_file.size()/sizeof(ActionRecord))
+        throw std::runtime_error("corrupt snapshot " + path);
+      Header expected = make_header(header.number_of_entries, header.number_of_actions,
+                                    header.table_size);
+      if (std::memcmp(&header, &expected, sizeof(Header)) || m_file.size() != file_size(header))
+        throw std::runtime_error("incompatible snapshot " + path);
+      const char* base = m_file.data() + sizeof(Header);
+      m_table = reinterpret_cast<const std::uint32_t*>(base);
+      m_table_mask = header.table_size - 1;
+      base += table_bytes(header.table_size);
+      m_entries = reinterpret_cast<const Entry*>(base);
+      m_number_of_entries = header.number_of_entries;
+      base += header.number_of_entries*sizeof(Entry);
+      m_actions = reinterpret_cast<const ActionRecord*>(base);
+    }
+
+    const Entry* find(const StateType& state) const {
+      StateHash<StateType> hash;
+      StateEqual<StateType> equal;
+      // bounded by the table size in case the table itself is corrupt
+      std::uint64_t slot = hash(state) & m_table_mask;
+      for (std::uint64_t probes = 0; probes <= m_table_mask && m_table[slot];
+           ++probes, slot = (slot + 1) & m_table_mask) {
+        std::uint32_t index = m_table[slot];
+        if (index > m_number_of_entries)
+          return nullptr;
+        const Entry& entry = m_entries[index - 1];
+        if (equal(entry.state, state))
+          return &entry;
+      }
+      return nullptr;
+    }
+
+    const ActionRecord* actions(const Entry& entry) const {
+      return m_actions + entry.first_action;
+    }
+
+    std::size_t size() const {
+      return m_number_of_entries;
+    }
+
+    std::size_t bytes() const {
+      return m_file.size();
+    }
+
+  private:
+    struct Header {
+      char magic[8];
+      std::uint32_t version, state_size, entry_size, action_size;
+      std::uint64_t number_of_entries, number_of_actions, table_size;
+    };
+
+    static Header make_header(
+        std::uint64_t number_of_entries,
+        std::uint64_t number_of_actions,
+        std::uint64_t table_size) {
+      Header header;
+      std::memset(&header, 0, sizeof(Header));
+      std::memcpy(header.magic, "MCTSSNAP", 8);
+      header.version = VERSION;
+      header.state_size = sizeof(StateType);
+      header.entry_size = sizeof(Entry);
+      header.action_size = sizeof(ActionRecord);
+      header.number_of_entries = number_of_entries;
+      header.number_of_actions = number_of_actions;
+      header.table_size = table_size;
+      return header;
+    }
+
+    // The table is padded to a multiple of 8 bytes
+    static std::size_t table_bytes(std::uint64_t table_size) {
+      return (table_size + table_size%2)*sizeof(std::uint32_t);
+    }
+
+    static std::size_t file_size(const Header& header) {
+      return sizeof(Header) + table_bytes(header.table_size)
+           + header.number_of_entries*sizeof(Entry)
+           + header.number_of_actions*sizeof(ActionRecord);
+    }
+
+    memory::MappedFile m_file;
+    const std::uint32_t* m_table;
+    std::uint64_t m_table_mask;
+    const Entry* m_entries;
+    std::size_t m_number_of_entries;
+    const ActionRecord* m_actions;
+};
+
+} // mcts
@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
@@ -11,12 +17,125 @@ using namespace multithreading;
 
 typedef Pool::Job Job;
 
+namespace {
+
+/*
+ * Chase-Lev work-stealing deque of jobs, after Lê et al., "Correct and
+ * efficient work-stealing for weak memory models" (with seq_cst operations
+ * in place of their seq_cst fences, which ThreadSanitizer can check). The
+ * owner pushes and takes at the bottom without locking while the thieves
+ * steal from the top. The ring buffer doubles when it is full; old buffers
+ * are kept until the deque is destroyed because a thief may still be
+ * reading from them.
+ */
+class WorkStealingDeque {
+  public:
+    WorkStealingDeque(int64_t capacity = 256) : m_top(0), m_bottom(0) {
+      m_buffers.push_back(make_unique<Buffer>(capacity));
+      m_buffer.store(m_buffers.back().get(), memory_order_relaxed);
+    }
+
+    // Owner only
+    void push(Job* job) {
+      int64_t bottom = m_bottom.load(memory_order_relaxed);
+      int64_t top = m_top.load(memory_order_acquire);
+      Buffer* buffer = m_buffer.load(memory_order_relaxed);
+      if (bottom - top > buffer->capacity - 1)
+        buffer = grow(buffer, bottom, top);
+      buffer->put(bottom, job);
+      // seq_cst so that a sleeping worker either sees the job or is notified
+      m_bottom.store(bottom + 1, memory_order_seq_cst);
+    }
+
+    // Owner only, nullptr if empty
+    Job* take() {
+      int64_t bottom = m_bottom.load(memory_order_relaxed) - 1;
+      Buffer* buffer = m_buffer.load(memory_order_relaxed);
+      m_bottom.store(bottom, memory_order_seq_cst);
+      int64_t top = m_top.load(memory_order_seq_cst);
+      Job* job = nullptr;
+      if (top <= bottom) {
+        job = buffer->get(bottom);
+        if (top == bottom) {
+          // last job: race against the thieves for it
+          if (!m_top.compare_exchange_strong(top, top + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+            job = nullptr;
+          m_bottom.store(bottom + 1, memory_order_relaxed);
+        }
+      }
+      else
+        m_bottom.store(bottom + 1, memory_order_relaxed);
+      return job;
+    }
+
+    // Any thread, nullptr if empty or if another thread got the job first
+    Job* steal() {
+      int64_t top = m_top.load(memory_order_seq_cst);
+      int64_t bottom = m_bottom.load(memory_order_seq_cst);
+      if (top >= bottom)
+        return nullptr;
+      Job* job = m_buffer.load(memory_order_acquire)->get(top);
+      if (!m_top.compare_exchange_strong(top, top + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+        return nullptr;
+      return job;
+    }
+
+  private:
+    struct Buffer {
+      int64_t capacity;  // power of 2
+      unique_ptr<atomic<Job*>[]> slots;
+
+      Buffer(int64_t capacity) : capacity(capacity), slots(new atomic<Job*>[capacity]) {}
+
+      Job* get(int64_t i) const {
+        return slots[i & (capacity - 1)].load(memory_order_relaxed);
+      }
+
+      void put(int64_t i, Job* job) {
+        slots[i & (capacity - 1)].store(job, memory_order_relaxed);
+      }
+    };
+
+    Buffer* grow(Buffer* buffer, int64_t bottom, int64_t top) {
+      m_buffers.push_back(make_unique<Buffer>(2*buffer->capacity));
+      Buffer* grown = m_buffers.back().get();
+      for (int64_t i = top; i < bottom; ++i)
+        grown->put(i, buffer->get(i));
+      m_buffer.store(grown, memory_order_release);
+      return grown;
+    }
+
+    atomic<int64_t> m_top, m_bottom;
+    atomic<Buffer*> m_buffer;
+    vector<unique_ptr<Buffer>> m_buffers;
+};
+
+// Rounds of stealing (yielding in between) before a worker goes to sleep
+const int SPIN_ROUNDS = 16;
+// Most jobs that a worker moves from the shared queue to its deque at once
+const size_t INJECTION_BATCH = 32;
+
+} // anonymous ns
+
+/*
+ * Work-stealing pool: each worker runs the jobs of its own deque (newest
+ * first) and, when it runs out, takes a batch of the jobs submitted from
+ * outside the pool or steals the oldest job of a random worker. Jobs added
+ * from a worker go to its deque without locking. Idle workers sleep on a
+ * condition variable and are only notified when some worker is sleeping.
+ */
 class Pool::PoolImpl {
   public:
     PoolImpl(unsigned number_of_workers);
 
     void add_job(Job job);
 
+    void add_background_job(Job job);
+
+    bool run_pending_job();
+
     void shutdown();
 
     void wait();
@@ -31,50 +150,119 @@ class Pool::PoolImpl {
 
   private:
 
-    void work();
+    struct Worker {
+      WorkStealingDeque deque;
+      uint64_t rng_state;
 
-    mutable mutex m_mtx;
+      Worker(uint64_t seed) : rng_state(seed) {}
+    };
+
+    void work(unsigned index);
+
+    Job* find_job(unsigned index, bool background);
+
+    Job* take_injected(unsigned index);
+
+    Job* take_background();
+
+    Job* steal(unsigned thief, uint64_t& rng_state);
+
+    void run(Job* job);
+
+    void notify_sleeper();
+
+    vector<unique_ptr<Worker>> m_workers;
+    vector<thread> m_threads;
+    mutable mutex m_mtx, m_injection_mtx;
     condition_variable m_worker_proceed, m_wait_empty;
-    queue<Job> m_job_queue;
-    vector<thread> m_workers;
-    unsigned m_pending_jobs;
-    bool m_active;
+    queue<Job*> m_injected, m_background;
+    atomic<size_t> m_injected_size, m_background_size;
+    atomic<unsigned> m_pending_jobs, m_sleepers;
+    atomic<bool> m_active;
+
+    // The pool and the index of the worker running on this thread, if any
+    static thread_local PoolImpl* t_pool;
+    static thread_local unsigned t_worker;
+    // Victim selection of the threads that are not workers
+    static thread_local uint64_t t_rng_state;
 };
 
-Pool::PoolImpl::PoolImpl(unsigned number_of_workers) : m_workers(number_of_workers),
+thread_local Pool::PoolImpl* Pool::PoolImpl::t_pool = nullptr;
+thread_local unsigned Pool::PoolImpl::t_worker = 0;
+thread_local uint64_t Pool::PoolImpl::t_rng_state =
+  hash<thread::id>()(this_thread::get_id()) | 1;
+
+Pool::PoolImpl::PoolImpl(unsigned number_of_workers) : m_injected_size(0),
+                                                       m_background_size(0),
                                                        m_pending_jobs(0),
+                                                       m_sleepers(0),
                                                        m_active(true)
 {
-  for (auto& worker : m_workers)
-    worker = thread(&PoolImpl::work, this);
+  for (unsigned i = 0; i < number_of_workers; ++i)
+    m_workers.push_back(make_unique<Worker>(0x9e3779b97f4a7c15ULL*(i + 1)));
+  for (unsigned i = 0; i < number_of_workers; ++i)
+    m_threads.emplace_back(&PoolImpl::work, this, i);
 }
 
 void Pool::PoolImpl::add_job(Job job) {
+  Job* task = new Job(move(job));
+  m_pending_jobs.fetch_add(1, memory_order_relaxed);
+  if (t_pool == this)
+    m_workers[t_worker]->deque.push(task);
+  else {
+    lock_guard lock(m_injection_mtx);
+    m_injected.push(task);
+    m_injected_size.store(m_injected.size(), memory_order_seq_cst);
+  }
+  notify_sleeper();
+}
+
+// Background jobs wait in a queue of their own, where only the workers
+// look for jobs to run
+void Pool::PoolImpl::add_background_job(Job job) {
+  Job* task = new Job(move(job));
+  m_pending_jobs.fetch_add(1, memory_order_relaxed);
   {
-    unique_lock lock(m_mtx);
-    m_job_queue.push(move(job));
-    ++m_pending_jobs;
+    lock_guard lock(m_injection_mtx);
+    m_background.push(task);
+    m_background_size.store(m_background.size(), memory_order_seq_cst);
   }
-  m_worker_proceed.notify_one();
+  notify_sleeper();
+}
+
+// Threads other than the workers take single jobs from the shared queue,
+// since they cannot push to a deque
+bool Pool::PoolImpl::run_pending_job() {
+  Job* job;
+  if (t_pool == this)
+    job = find_job(t_worker, false);
+  else {
+    job = take_injected(m_workers.size());
+    if (!job && !m_workers.empty())
+      job = steal(m_workers.size(), t_rng_state);
+  }
+  if (!job)
+    return false;
+  run(job);
+  return true;
 }
 
 void Pool::PoolImpl::shutdown() {
   bool active;
   {
     unique_lock lock(m_mtx);
-    active = m_active;
-    m_active = false;
+    active = m_active.exchange(false);
   }
   if (active) {
     m_worker_proceed.notify_all();
-    for (auto& worker : m_workers)
+    for (auto& worker : m_threads)
       worker.join();
   }
 }
 
 void Pool::PoolImpl::wait() {
   unique_lock lock(m_mtx);
-  m_wait_empty.wait(lock, [this]{ return m_pending_jobs == 0; });
+  m_wait_empty.wait(lock, [this]{ return m_pending_jobs.load() == 0; });
 }
 
 bool Pool::PoolImpl::is_active() const {
@@ -82,38 +270,127 @@ bool Pool::PoolImpl::is_active() const {
 }
 
 unsigned Pool::PoolImpl::pending_jobs() const {
-  unique_lock lock(m_mtx);
   return m_pending_jobs;
 }
 
 unsigned Pool::PoolImpl::number_of_workers() const {
-  return m_workers.size();
+  return m_threads.size();
 }
 
+// Jobs still queued at this point are dropped, as they would never run
 Pool::PoolImpl::~PoolImpl() {
   shutdown();
+  for (auto& worker : m_workers) {
+    while (Job* job = worker->deque.take())
+      delete job;
+  }
+  for (; !m_injected.empty(); m_injected.pop())
+    delete m_injected.front();
+  for (; !m_background.empty(); m_background.pop())
+    delete m_background.front();
 }
 
-
-void Pool::PoolImpl::work() {
+void Pool::PoolImpl::work(unsigned index) {
+  t_pool = this;
+  t_worker = index;
   while (true) {
-    Job job;
-    {
-      unique_lock lock(m_mtx);
-      m_worker_proceed.wait(lock, [this]{return !m_job_queue.empty() || !m_active; });
-      if (!is_active())
-        break;
-      job = move(m_job_queue.front());
-      m_job_queue.pop();
+    Job* job = find_job(index, true);
+    for (int round = 0; !job && round < SPIN_ROUNDS && is_active(); ++round) {
+      this_thread::yield();
+      job = find_job(index, true);
     }
-    job();
-    unsigned pending_jobs;
-    {
+    if (!job) {
       unique_lock lock(m_mtx);
-      pending_jobs = --m_pending_jobs;
+      // all seq_cst, as the publication of the jobs: either the submitter
+      // sees this worker sleeping or the worker sees the job
+      m_sleepers.fetch_add(1, memory_order_seq_cst);
+      while (is_active() && !(job = find_job(index, true)))
+        m_worker_proceed.wait(lock);
+      m_sleepers.fetch_sub(1, memory_order_relaxed);
     }
-    if (!pending_jobs)
-      m_wait_empty.notify_all();
+    if (!is_active()) {
+      if (job)
+        m_workers[index]->deque.push(job);
+      break;
+    }
+    run(job);
+  }
+}
+
+// Background jobs never enter the deques, so they are only found here
+Job* Pool::PoolImpl::find_job(unsigned index, bool background) {
+  if (Job* job = m_workers[index]->deque.take())
+    return job;
+  if (Job* job = take_injected(index))
+    return job;
+  if (background) {
+    if (Job* job = take_background())
+      return job;
+  }
+  return steal(index, m_workers[index]->rng_state);
+}
+
+// Moves a batch of the jobs submitted from outside to the deque of worker
+// index (if it is a worker) and returns the first one
+Job* Pool::PoolImpl::take_injected(unsigned index) {
+  if (!m_injected_size.load(memory_order_seq_cst))
+    return nullptr;
+  lock_guard lock(m_injection_mtx);
+  if (m_injected.empty())
+    return nullptr;
+  Job* job = m_injected.front();
+  m_injected.pop();
+  size_t batch = index < m_workers.size()?
+    min(INJECTION_BATCH, m_injected.size()/m_workers.size()) : 0;
+  for (size_t i = 0; i < batch; ++i) {
+    m_workers[index]->deque.push(m_injected.front());
+    m_injected.pop();
+  }
+  m_injected_size.store(m_injected.size(), memory_order_relaxed);
+  return job;
+}
+
+Job* Pool::PoolImpl::take_background() {
+  if (!m_background_size.load(memory_order_seq_cst))
+    return nullptr;
+  lock_guard lock(m_injection_mtx);
+  if (m_background.empty())
+    return nullptr;
+  Job* job = m_background.front();
+  m_background.pop();
+  m_background_size.store(m_background.size(), memory_order_relaxed);
+  return job;
+}
+
+Job* Pool::PoolImpl::steal(unsigned thief, uint64_t& x) {
+  unsigned n = m_workers.size();
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  unsigned start = x % n;
+  for (unsigned i = 0; i < n; ++i) {
+    unsigned victim = (start + i) % n;
+    if (victim == thief)
+      continue;
+    if (Job* job = m_workers[victim]->deque.steal())
+      return job;
+  }
+  return nullptr;
+}
+
+void Pool::PoolImpl::run(Job* job) {
+  (*job)();
+  delete job;
+  if (m_pending_jobs.fetch_sub(1, memory_order_acq_rel) == 1) {
+    lock_guard lock(m_mtx);
+    m_wait_empty.notify_all();
+  }
+}
+
+void Pool::PoolImpl::notify_sleeper() {
+  if (m_sleepers.load(memory_order_seq_cst)) {
+    lock_guard lock(m_mtx);
+    m_worker_proceed.notify_one();
   }
 }
 
@@ -125,6 +402,14 @@ void Pool::add_job(Job job) {
   m_impl->add_job(move(job));
 }
 
+void Pool::add_background_job(Job job) {
+  m_impl->add_background_job(move(job));
+}
+
+bool Pool::run_pending_job() {
+  return m_impl->run_pending_job();
+}
+
 void Pool::shutdown() {
   m_impl->shutdown();
 }
@@ -147,3 +432,32 @@ unsigned Pool::number_of_workers() const {
 
 Pool::~Pool() = default;
 
+// While the group is busy, run pending jobs of the pool (which need not be
+// jobs of the group), and sleep until a job of the group finishes or a
+// short timeout when there are none
+void TaskGroup::help_until_done() {
+  while (m_pending.load(memory_order_acquire)) {
+    if (m_pool.run_pending_job())
+      continue;
+    unique_lock lock(m_mtx);
+    m_done.wait_for(lock, chrono::microseconds(100),
+        [this]{ return !m_pending.load(memory_order_acquire); });
+  }
+  // synchronize with the job that finished last, which notifies under the lock
+  lock_guard lock(m_mtx);
+}
+
+void TaskGroup::wait() {
+  help_until_done();
+  exception_ptr exception;
+  {
+    lock_guard lock(m_mtx);
+    swap(exception, m_exception);
+  }
+  if (exception)
+    rethrow_exception(exception);
+}
+
+TaskGroup::~TaskGroup() {
+  help_until_done();
+}
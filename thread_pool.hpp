@@ -1,10 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace multithreading {
 
@@ -20,16 +26,34 @@ class Pool {
 
     template<class F, class... Args>
     auto async(F&& fun, Args&&... args) {
-      typedef std::invoke_result_t<F,Args...> ResultType;
-      typedef std::packaged_task<ResultType()> PackagedTask;
-      auto job = std::make_shared<PackagedTask>(
-          std::bind(std::forward<F>(fun), std::forward<Args>(args)...));
-      add_job([job] { (*job)(); } );
-      return job->get_future();
+      auto[job, future] = package(std::forward<F>(fun), std::forward<Args>(args)...);
+      add_job(std::move(job));
+      return std::move(future);
+    }
+
+    /*
+     * Jobs that may run until their caller stops them, such as pondering
+     * and asynchronous searches. Only the workers pick them up: threads
+     * that help while they wait (see run_pending_job and TaskGroup) never
+     * do, since the job they would run could be waiting for them.
+     */
+    void add_background_job(Job job);
+
+    template<class F, class... Args>
+    auto background_async(F&& fun, Args&&... args) {
+      auto[job, future] = package(std::forward<F>(fun), std::forward<Args>(args)...);
+      add_background_job(std::move(job));
+      return std::move(future);
     }
 
+    // Runs one pending job on the calling thread (false if there was none).
+    // Background jobs are left to the workers
+    bool run_pending_job();
+
     void shutdown();
 
+    // Blocks until every job has run. Must not be called from a job of the
+    // pool itself, use a TaskGroup there
     void wait();
 
     bool is_active() const;
@@ -42,9 +66,139 @@ class Pool {
 
   private:
 
+    // The job that runs fun(args...) and the future of its result
+    template<class F, class... Args>
+    static auto package(F&& fun, Args&&... args) {
+      typedef std::invoke_result_t<F,Args...> ResultType;
+      typedef std::packaged_task<ResultType()> PackagedTask;
+      auto task = std::make_shared<PackagedTask>(
+          std::bind(std::forward<F>(fun), std::forward<Args>(args)...));
+      return std::make_pair(Job([task] { (*task)(); }), task->get_future());
+    }
+
     class PoolImpl;
     std::unique_ptr<PoolImpl> m_impl;
 };
 
+/*
+ * Set of jobs of a pool that can be waited on independently of the rest.
+ * The waiting thread runs pending jobs of the pool in the meantime (and
+ * only sleeps for short periods when there are none), so groups can be
+ * nested inside jobs of the same pool without deadlocking it. wait()
+ * rethrows the first exception thrown by a job of the group.
+ *
+ * The jobs that a waiter runs need not belong to the group, so they must
+ * finish on their own: a job that runs until its caller stops it (such as
+ * Mcts::ponder or search_async) would never return to a waiter that is its
+ * own caller. Those go through Pool::add_background_job, which waiters
+ * never pick up.
+ */
+class TaskGroup {
+  public:
+    TaskGroup(Pool& pool) : m_pool(pool), m_pending(0) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template<class F>
+    void run(F&& fun) {
+      m_pending.fetch_add(1, std::memory_order_relaxed);
+      m_pool.add_job([this, fun = std::forward<F>(fun)]() mutable {
+        std::exception_ptr exception;
+        try {
+          fun();
+        }
+        catch (...) {
+          exception = std::current_exception();
+        }
+        // under the lock: the group may be destroyed as soon as it is done
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (exception && !m_exception)
+          m_exception = exception;
+        if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+          m_done.notify_all();
+      });
+    }
+
+    void wait();
+
+    ~TaskGroup();
+
+  private:
+    void help_until_done();
+
+    Pool& m_pool;
+    std::atomic<unsigned> m_pending;
+    std::mutex m_mtx;
+    std::condition_variable m_done;
+    std::exception_ptr m_exception;
+};
+
+// Chunk size that gives about four chunks per worker
+template<class Index>
+Index default_grain(const Pool& pool, Index size) {
+  Index chunks = 4*std::max(1U, pool.number_of_workers());
+  return std::max<Index>(1, size/chunks);
+}
+
+/*
+ * Calls fun(i) for every i in [begin, end), in chunks of grain indices run
+ * as jobs of the pool. The calling thread runs the last chunk and then
+ * helps with the rest.
+ */
+template<class Index, class F>
+void parallel_for(Pool& pool, Index begin, Index end, F fun, Index grain = 0) {
+  if (begin >= end)
+    return;
+  if (grain <= 0)
+    grain = default_grain(pool, end - begin);
+  TaskGroup group(pool);
+  Index chunk_begin = begin;
+  for (; end - chunk_begin > grain; chunk_begin += grain) {
+    group.run([&fun, chunk_begin, grain] {
+      for (Index i = chunk_begin; i < chunk_begin + grain; ++i)
+        fun(i);
+    });
+  }
+  for (Index i = chunk_begin; i < end; ++i)
+    fun(i);
+  group.wait();
+}
+
+/*
+ * Reduces map(i) for every i in [begin, end) with reduce, starting from
+ * identity. The chunks are reduced in parallel and their results combined
+ * in index order, so the result does not depend on the scheduling.
+ */
+template<class Index, class T, class Map, class Reduce>
+T parallel_reduce(
+    Pool& pool,
+    Index begin,
+    Index end,
+    T identity,
+    Map map,
+    Reduce reduce,
+    Index grain = 0) {
+  if (begin >= end)
+    return identity;
+  if (grain <= 0)
+    grain = default_grain(pool, end - begin);
+  Index number_of_chunks = (end - begin + grain - 1)/grain;
+  std::vector<T> partial_results(number_of_chunks, identity);
+  parallel_for(pool, Index(0), number_of_chunks, [&](Index chunk) {
+    Index chunk_begin = begin + chunk*grain;
+    Index chunk_end = std::min(end, chunk_begin + grain);
+    T result = identity;
+    for (Index i = chunk_begin; i < chunk_end; ++i)
+      result = reduce(std::move(result), map(i));
+    partial_results[chunk] = std::move(result);
+  }, Index(1));
+  T result = std::move(identity);
+  for (auto& partial_result : partial_results)
+    result = reduce(std::move(result), std::move(partial_result));
+  return result;
+}
+
 } // multithreading
 
@@ -0,0 +1,1251 @@
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "batched_rollouts.hpp"
+#include "better_rand.hpp"
+#include "bidding_game.hpp"
+#include "mcts.hpp"
+#include "parallel_mcts.hpp"
+#include "random_utils.hpp"
+#include "snapshot.hpp"
+#include "tictactoe.hpp"
+#include "tictactoe_utils.hpp"
+#include "tournament.hpp"
+#include "ultimate_tictactoe.hpp"
+using namespace std;
+using namespace mcts;
+
+namespace {
+
+// Live bytes are measured as glibc sees them: usable size plus chunk header
+const size_t CHUNK_HEADER = sizeof(size_t);
+atomic<long> allocation_count(0), live_bytes(0), peak_bytes(0);
+
+} // anonymous ns
+
+void* operator new(size_t size) {
+  void* ptr = malloc(size);
+  if (!ptr)
+    throw bad_alloc();
+  ++allocation_count;
+  long bytes = live_bytes += malloc_usable_size(ptr) + CHUNK_HEADER;
+  long peak = peak_bytes.load(memory_order_relaxed);
+  while (bytes > peak && !peak_bytes.compare_exchange_weak(peak, bytes, memory_order_relaxed));
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (!ptr)
+    return;
+  live_bytes -= malloc_usable_size(ptr) + CHUNK_HEADER;
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  operator delete(ptr);
+}
+
+namespace {
+
+typedef ultimate_tictactoe::Environment Environment;
+typedef StandardBackup<Environment,SampleAverage> Backup;
+typedef RandomPolicy<shared_ptr<pcg32>> Policy;
+
+const double BUDGET_S = 1.0;
+
+shared_ptr<pcg32> make_rng(uint64_t seed) {
+  return make_shared<pcg32>(seed);
+}
+
+double simulations_per_second(MctsBase<Environment>& algorithm) {
+  Environment env;
+  algorithm.search(env, nullptr, BUDGET_S);
+  const auto& stats = algorithm.get_statistics();
+  return stats.number_of_simulations_last / stats.elapsed_last_call;
+}
+
+vector<unsigned> thread_counts() {
+  unsigned hardware_threads = max(1U, thread::hardware_concurrency());
+  vector<unsigned> counts;
+  for (unsigned n = 1; n < hardware_threads; n *= 2)
+    counts.push_back(n);
+  counts.push_back(hardware_threads);
+  return counts;
+}
+
+template<template<class...> class ParallelMcts>
+void parallel_scaling(const string& title, const string& unit) {
+  Mcts<Environment,UctSelect,Policy,Backup> sequential(
+      UctSelect(0.5), Policy(make_rng(1)), Backup());
+  double base_rate = simulations_per_second(sequential);
+  cout << title << " scaling (ultimate_tictactoe, "
+       << BUDGET_S << "s per search)\n"
+       << setw(8) << unit << setw(14) << "sims/s"
+       << setw(10) << "speedup" << setw(12) << "efficiency" << '\n'
+       << setw(8) << "seq" << setw(14) << fixed << setprecision(0) << base_rate
+       << setw(10) << setprecision(2) << 1.0 << setw(12) << 1.0 << '\n';
+  for (unsigned n : thread_counts()) {
+    vector<Policy> policies;
+    for (const pcg32& rng : split_streams(pcg32(1), n))
+      policies.emplace_back(make_shared<pcg32>(rng));
+    ParallelMcts<Environment,UctSelect,Policy,Backup> parallel(
+        UctSelect(0.5), move(policies), Backup());
+    double rate = simulations_per_second(parallel);
+    cout << setw(8) << n << setw(14) << setprecision(0) << rate
+         << setw(10) << setprecision(2) << rate/base_rate
+         << setw(12) << rate/base_rate/n << '\n';
+  }
+  cout << defaultfloat << endl;
+}
+
+void leaf_parallel_scaling() {
+  cout << "Leaf-parallel rollouts (ultimate_tictactoe, "
+       << BUDGET_S << "s per search)\n"
+       << setw(8) << "rollouts" << setw(14) << "sims/s"
+       << setw(14) << "rollouts/s" << '\n' << fixed << setprecision(0);
+  for (unsigned n : thread_counts()) {
+    vector<Policy> policies;
+    for (const pcg32& rng : split_streams(pcg32(1), n))
+      policies.emplace_back(make_shared<pcg32>(rng));
+    Mcts<Environment,UctSelect,LeafParallelPolicy<Policy>,Backup> algorithm(
+        UctSelect(0.5), LeafParallelPolicy<Policy>(move(policies)), Backup());
+    double rate = simulations_per_second(algorithm);
+    cout << setw(8) << n << setw(14) << rate << setw(14) << rate*n << '\n';
+  }
+  cout << defaultfloat << endl;
+}
+
+// Scalar random rollouts against the lanes of BatchedRollouts, from the
+// initial position and as the leaf evaluator of a search
+void batched_rollouts() {
+  using namespace chrono;
+  typedef ultimate_tictactoe::BatchedRollouts Batched;
+  const int number_of_rollouts = 100000;
+  Environment env;
+  Policy policy(make_rng(1));
+  Reward<Environment> scalar_mean{};
+  auto start = steady_clock::now();
+  for (int i = 0; i < number_of_rollouts; ++i)
+    scalar_mean += (1.0/number_of_rollouts)*rollout(env, policy);
+  duration<double> scalar = steady_clock::now() - start;
+  Batched batched(1);
+  Reward<Environment> batched_mean{};
+  const int number_of_batches = number_of_rollouts/Batched::LANES;
+  start = steady_clock::now();
+  for (int i = 0; i < number_of_batches; ++i)
+    batched_mean += (1.0/number_of_batches)*batched.evaluate(env, 1);
+  duration<double> lanes = steady_clock::now() - start;
+  Mcts<Environment,UctSelect,Policy,Backup> scalar_search(
+      UctSelect(0.5), Policy(make_rng(1)), Backup());
+  Mcts<Environment,UctSelect,Batched,Backup> batched_search(
+      UctSelect(0.5), Batched(1), Backup());
+  double scalar_rate = simulations_per_second(scalar_search);
+  double batched_rate = simulations_per_second(batched_search);
+  cout << "Batched rollouts (ultimate_tictactoe, " << Batched::LANES << " lanes, "
+       << (simd::avx2_enabled()? "avx2" : "portable") << ")\n"
+       << setw(10) << "rollouts" << setw(14) << "rollouts/s" << setw(10) << "x score"
+       << setw(14) << "search sims/s" << setw(18) << "search rollouts/s" << '\n'
+       << fixed << setprecision(0)
+       << setw(10) << "scalar" << setw(14) << number_of_rollouts/scalar.count()
+       << setprecision(3) << setw(10) << scalar_mean[0] << setprecision(0)
+       << setw(14) << scalar_rate << setw(18) << scalar_rate << '\n'
+       << setw(10) << "batched" << setw(14) << number_of_batches*Batched::LANES/lanes.count()
+       << setprecision(3) << setw(10) << batched_mean[0] << setprecision(0)
+       << setw(14) << batched_rate << setw(18) << batched_rate*Batched::LANES << '\n'
+       << defaultfloat << endl;
+}
+
+// Draws per second of the standard distributions, set up on every call as
+// the policies used to, against the helpers of random_utils.hpp
+template<class Random>
+void random_row(const string& name) {
+  using namespace chrono;
+  const int number_of_draws = 10000000;
+  const uint32_t range = 40;  // about the actions of a node
+  auto rate = [number_of_draws](auto&& draw) {
+    uint64_t acc = 0;
+    auto start = steady_clock::now();
+    for (int i = 0; i < number_of_draws; ++i)
+      acc += draw();
+    duration<double> elapsed = steady_clock::now() - start;
+    if (acc == 1)
+      cerr << acc;
+    return number_of_draws/elapsed.count();
+  };
+  Random rng(1);
+  RandomBuffer<Random> buffer(Random(1));
+  cout << setw(14) << name
+       << setw(12) << rate([&rng, range] {
+            uniform_int_distribution<> dist(0, range - 1);
+            return dist(rng);
+          })
+       << setw(12) << rate([&rng, range] { return bounded_random(rng, range); })
+       << setw(12) << rate([&buffer, range] { return bounded_random(buffer, range); })
+       << setw(12) << rate([&rng] {
+            uniform_real_distribution<> dist(0, 1);
+            return dist(rng) < 0.1;
+          })
+       << setw(12) << rate([&rng] { return random_real(rng) < 0.1; }) << '\n';
+}
+
+void random_sampling() {
+  cout << "Random draws per second (integers in [0, 40), reals in [0, 1))\n"
+       << setw(14) << "generator" << setw(12) << "std int" << setw(12) << "bounded"
+       << setw(12) << "buffered" << setw(12) << "std real" << setw(12) << "real" << '\n'
+       << fixed << setprecision(0);
+  random_row<pcg32>("pcg32");
+  random_row<xoshiro256ss>("xoshiro256ss");
+  cout << defaultfloat << endl;
+}
+
+vector<Environment::State> random_states(unsigned count, uint64_t seed) {
+  pcg32 rng(seed);
+  memory::LruMap<Environment::State,bool> seen(count);
+  vector<Environment::State> states;
+  states.reserve(count);
+  while (states.size() < count) {
+    Environment env;
+    while (!env.is_terminal() && states.size() < count) {
+      if (seen.find(env.get_state()) == seen.end()) {
+        seen[env.get_state()] = true;
+        states.push_back(env.get_state());
+      }
+      auto actions = env.get_available_actions();
+      env.step(actions[rng()%actions.size()]);
+    }
+  }
+  return states;
+}
+
+template< template<class...> class Map,
+          class Hash = std::hash<Environment::State>,
+          class KeyEqual = std::equal_to<Environment::State> >
+double lookups_per_second(
+    const vector<Environment::State>& keys,
+    const vector<Environment::State>& probes) {
+  using namespace chrono;
+  Map<Environment::State,int,Hash,KeyEqual> map(keys.size());
+  for (unsigned i = 0; i < keys.size(); ++i)
+    map[keys[i]] = i;
+  const int rounds = 10;
+  long found = 0;
+  auto start = steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (const auto& probe : probes)
+      found += map.find(probe) != map.end();
+  }
+  duration<double> elapsed = steady_clock::now() - start;
+  if (found < 0)
+    cerr << found;
+  return rounds*probes.size()/elapsed.count();
+}
+
+template<template<class...> class Map>
+double map_simulations_per_second(int memory_capacity) {
+  Mcts<Environment,UctSelect,Policy,Backup,Map> algorithm(
+      UctSelect(0.5), Policy(make_rng(1)), Backup(), memory_capacity);
+  return simulations_per_second(algorithm);
+}
+
+void memory_maps() {
+  const unsigned number_of_keys = 200000;
+  auto keys = random_states(number_of_keys, 1);
+  auto probes = random_states(number_of_keys, 2);
+  pcg32 rng(3);
+  for (unsigned i = 0; i < probes.size(); i += 2)
+    probes[i] = keys[rng()%keys.size()];
+  cout << "Memory maps (ultimate_tictactoe states, "
+       << number_of_keys << " keys, 50% hits)\n"
+       << setw(10) << "map" << setw(14) << "lookups/s"
+       << setw(18) << "sims/s (300000)" << setw(16) << "sims/s (5000)" << '\n'
+       << fixed << setprecision(0)
+       << setw(10) << "LruMap"
+       << setw(14) << lookups_per_second<memory::LruMap>(keys, probes)
+       << setw(18) << map_simulations_per_second<memory::LruMap>(300000)
+       << setw(16) << map_simulations_per_second<memory::LruMap>(5000) << '\n'
+       << setw(10) << "ClockMap"
+       << setw(14) << lookups_per_second<memory::ClockMap>(keys, probes)
+       << setw(18) << map_simulations_per_second<memory::ClockMap>(300000)
+       << setw(16) << map_simulations_per_second<memory::ClockMap>(5000) << '\n'
+       << defaultfloat << endl;
+}
+
+// Hashes every field, as ultimate_tictactoe::State did before Zobrist keys
+struct FullStateHash {
+  size_t operator()(const Environment::State& state) const {
+    size_t seed = 0;
+    hash_combine(seed, state.active_subboard);
+    for (auto subboard : state.subboards)
+      hash_combine(seed, subboard);
+    return seed;
+  }
+};
+
+template<class Hash>
+double hashes_per_second(const vector<Environment::State>& states) {
+  using namespace chrono;
+  const int rounds = 50;
+  Hash hash;
+  size_t checksum = 0;
+  auto start = steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (const auto& state : states)
+      checksum += hash(state);
+  }
+  duration<double> elapsed = steady_clock::now() - start;
+  if (!checksum)
+    cerr << checksum;
+  return rounds*states.size()/elapsed.count();
+}
+
+template<class Hash, class KeyEqual>
+void state_hashing_row(
+    const string& name,
+    const vector<Environment::State>& keys,
+    const vector<Environment::State>& probes) {
+  cout << setw(10) << name
+       << setw(14) << hashes_per_second<Hash>(probes)
+       << setw(14) << lookups_per_second<memory::LruMap,Hash,KeyEqual>(keys, probes)
+       << setw(14) << lookups_per_second<memory::ClockMap,Hash,KeyEqual>(keys, probes)
+       << '\n';
+}
+
+void state_hashing() {
+  typedef Environment::State State;
+  const unsigned number_of_keys = 200000;
+  auto keys = random_states(number_of_keys, 1);
+  auto probes = random_states(number_of_keys, 2);
+  pcg32 rng(3);
+  for (unsigned i = 0; i < probes.size(); i += 2)
+    probes[i] = keys[rng()%keys.size()];
+  cout << "State hashing (ultimate_tictactoe states, "
+       << number_of_keys << " keys, 50% hits)\n"
+       << setw(10) << "hash" << setw(14) << "hashes/s"
+       << setw(14) << "LruMap" << setw(14) << "ClockMap" << '\n'
+       << fixed << setprecision(0);
+  state_hashing_row<FullStateHash,equal_to<State>>("full", keys, probes);
+  state_hashing_row<StateHash<State>,StateEqual<State>>("zobrist", keys, probes);
+  cout << defaultfloat << endl;
+}
+
+template<class NodeBackup>
+void node_storage_row(const string& name) {
+  const int number_of_simulations = 20000;
+  Mcts<Environment,UctSelect,Policy,NodeBackup> algorithm(
+      UctSelect(0.5), Policy(make_rng(1)), NodeBackup());
+  long allocations_before = allocation_count;
+  long bytes_before = live_bytes;
+  Environment env;
+  algorithm.search(env, nullptr, -1, number_of_simulations);
+  double allocations = allocation_count - allocations_before;
+  double bytes = live_bytes - bytes_before;
+  const auto& stats = algorithm.get_statistics();
+  cout << setw(10) << name
+       << setw(14) << stats.number_of_simulations_last/stats.elapsed_last_call
+       << setw(14) << allocations/number_of_simulations
+       << setw(14) << bytes/algorithm.memory_usage() << '\n';
+}
+
+void node_storage() {
+  cout << "Node storage (ultimate_tictactoe, 20000 simulations)\n"
+       << setw(10) << "storage" << setw(14) << "sims/s"
+       << setw(14) << "allocs/sim" << setw(14) << "bytes/node" << '\n'
+       << fixed << setprecision(1);
+  node_storage_row<Backup>("vector");
+  node_storage_row<ArenaNodes<Backup>>("arena");
+  node_storage_row<SoaNodes<Backup>>("soa");
+  cout << defaultfloat << endl;
+}
+
+/*
+ * The original std::bitset based ultimate_tictactoe, kept as a reference to
+ * check that the bitboard environment generates exactly the same game tree.
+ */
+class ReferenceUltimate {
+  public:
+    typedef Environment::Action Action;
+    typedef Environment::Reward Reward;
+
+    ReferenceUltimate() : m_score{0, 0}, m_active_subboard(-1), m_turn(0), m_current_player(0) {
+      m_playable_subboards.set();
+    }
+
+    vector<Action> get_available_actions() const {
+      vector<Action> available_actions;
+      for (int subboard = 0; subboard < 9; ++subboard) {
+        if (m_active_subboard != -1 && subboard != m_active_subboard)
+          continue;
+        if (!m_playable_subboards[subboard])
+          continue;
+        for (int cell = 0; cell < 9; ++cell) {
+          if (tictactoe::is_free_cell(m_subboards[subboard], cell))
+            available_actions.push_back({subboard, cell});
+        }
+      }
+      return available_actions;
+    }
+
+    bool is_terminal() const { return m_score[0] || m_score[1]; }
+
+    const Reward& get_score() const { return m_score; }
+
+    const Reward& step(const Action& action) {
+      using tictactoe::Result;
+      tictactoe::make_move(m_subboards[action.subboard], action.cell, m_current_player);
+      Result result = tictactoe::calculate_result(m_subboards[action.subboard]);
+      if (result != Result::ongoing) {
+        m_playable_subboards[action.subboard] = false;
+        m_x_winned_subboards[action.subboard] = result == Result::x_wins;
+        m_o_winned_subboards[action.subboard] = result == Result::o_wins;
+        update_score();
+      }
+      ++m_turn;
+      m_current_player = !m_current_player;
+      m_active_subboard = m_playable_subboards[action.cell]? action.cell : -1;
+      return m_score;
+    }
+
+  private:
+    void update_score() {
+      using tictactoe::LU_TABLE;
+      bool x_ttt = LU_TABLE[m_x_winned_subboards.to_ulong()];
+      bool o_ttt = LU_TABLE[m_o_winned_subboards.to_ulong()];
+      bool more_plays = m_playable_subboards.any();
+      int x_win_count = m_x_winned_subboards.count();
+      int o_win_count = m_o_winned_subboards.count();
+      bool x_wins = x_ttt || (!more_plays && !o_ttt && x_win_count>o_win_count);
+      bool o_wins = o_ttt || (!more_plays && !x_ttt && o_win_count>x_win_count);
+      bool tie = !x_wins && !o_wins && !more_plays;
+      m_score[0] = x_wins + 0.5*tie;
+      m_score[1] = o_wins + 0.5*tie;
+    }
+
+    Reward m_score;
+    array<tictactoe::Board,9> m_subboards;
+    bitset<9> m_playable_subboards, m_x_winned_subboards, m_o_winned_subboards;
+    int m_active_subboard, m_turn, m_current_player;
+};
+
+template<class Env>
+long perft(const Env& env, int depth) {
+  if (depth == 0 || env.is_terminal())
+    return 1;
+  long leaves = 0;
+  for (const auto& action : env.get_available_actions()) {
+    Env child = env;
+    child.step(action);
+    leaves += perft(child, depth - 1);
+  }
+  return leaves;
+}
+
+// Plays random games with both environments in lockstep
+bool same_random_games(int number_of_games) {
+  pcg32 rng(7);
+  for (int game = 0; game < number_of_games; ++game) {
+    Environment env;
+    ReferenceUltimate reference;
+    while (!env.is_terminal()) {
+      auto actions = env.get_available_actions();
+      auto reference_actions = reference.get_available_actions();
+      if (!equal(actions.begin(), actions.end(),
+            reference_actions.begin(), reference_actions.end()))
+        return false;
+      auto action = actions[rng()%actions.size()];
+      if (env.step(action) != reference.step(action))
+        return false;
+    }
+    if (!reference.is_terminal())
+      return false;
+  }
+  return true;
+}
+
+template<class Env>
+double steps_per_second(int number_of_games) {
+  using namespace chrono;
+  pcg32 rng(7);
+  long steps = 0;
+  auto start = steady_clock::now();
+  for (int game = 0; game < number_of_games; ++game) {
+    Env env;
+    while (!env.is_terminal()) {
+      auto actions = env.get_available_actions();
+      env.step(actions[rng()%actions.size()]);
+      ++steps;
+    }
+  }
+  duration<double> elapsed = steady_clock::now() - start;
+  return steps/elapsed.count();
+}
+
+void ultimate_perft() {
+  using namespace chrono;
+  const int depth = 5;
+  const int number_of_games = 20000;
+  cout << "Ultimate tictactoe bitboards\n";
+  for (int d = 1; d <= depth; ++d) {
+    auto start = steady_clock::now();
+    long leaves = perft(Environment(), d);
+    duration<double> elapsed = steady_clock::now() - start;
+    long reference_leaves = perft(ReferenceUltimate(), d);
+    cout << "perft(" << d << ") = " << leaves
+         << (leaves == reference_leaves? " (matches reference)" : " (MISMATCH)")
+         << ", " << fixed << setprecision(0) << leaves/elapsed.count()
+         << " leaves/s\n" << defaultfloat;
+  }
+  cout << number_of_games << " random games: "
+       << (same_random_games(number_of_games)? "identical" : "MISMATCH") << '\n'
+       << fixed << setprecision(0)
+       << "steps/s (bitboards): " << steps_per_second<Environment>(number_of_games) << '\n'
+       << "steps/s (reference): " << steps_per_second<ReferenceUltimate>(number_of_games) << '\n'
+       << defaultfloat << endl;
+}
+
+template<class Node, class Selector>
+double selections_per_second(const Node& node, const Selector& selector, int& result) {
+  using namespace chrono;
+  const int repetitions = 200000;
+  long checksum = 0;
+  auto start = steady_clock::now();
+  for (int i = 0; i < repetitions; ++i) {
+    // Keeps the compiler from hoisting the selection out of the loop
+    asm volatile("" : : "g"(&node) : "memory");
+    checksum += selector(node);
+  }
+  duration<double> elapsed = steady_clock::now() - start;
+  result = checksum/repetitions;
+  return repetitions/elapsed.count();
+}
+
+template<class Selector>
+void selection_row(
+    const string& name,
+    int branching_factor,
+    const Selector& selector) {
+  typedef ActionInfoBase<Environment> ActionInfo;
+  NodeBase<ActionInfo> aos_node;
+  NodeBase<ActionInfo,SoaActionStorage<ActionInfo>> soa_node;
+  aos_node.action_vector.resize(branching_factor);
+  soa_node.action_vector = SoaActionStorage<ActionInfo>(branching_factor);
+  aos_node.visits = soa_node.visits = 0;
+  aos_node.maximizing_player = soa_node.maximizing_player = 1;
+  pcg32 rng(branching_factor);
+  for (int i = 0; i < branching_factor; ++i) {
+    int visits = 1 + rng()%1000;
+    Environment::Reward value{double(rng())/pcg32::max(), double(rng())/pcg32::max()};
+    aos_node.action_vector[i].visits = soa_node.action_vector[i].visits = visits;
+    aos_node.action_vector[i].expected_return = soa_node.action_vector[i].expected_return = value;
+    aos_node.visits += visits;
+    soa_node.visits += visits;
+  }
+  int aos_result, soa_result;
+  double aos_rate = selections_per_second(aos_node, selector, aos_result);
+  double soa_rate = selections_per_second(soa_node, selector, soa_result);
+  cout << setw(12) << name << setw(8) << branching_factor
+       << setw(14) << aos_rate << setw(14) << soa_rate
+       << setw(10) << setprecision(2) << soa_rate/aos_rate << setprecision(0)
+       << (aos_result == soa_result? "" : "  MISMATCH") << '\n';
+}
+
+void selection_kernels() {
+  cout << "Selection kernels (AVX2 " << (simd::avx2_enabled()? "on" : "off") << ")\n"
+       << setw(12) << "selector" << setw(8) << "width"
+       << setw(14) << "AoS sel/s" << setw(14) << "SoA sel/s"
+       << setw(10) << "speedup" << '\n' << fixed << setprecision(0);
+  for (int branching_factor : {9, 27, 81, 101}) {
+    selection_row("uct", branching_factor, UctSelect(0.5));
+    selection_row("greedy", branching_factor, GreedySelect());
+    selection_row("most-visited", branching_factor, MostVisitedSelect());
+  }
+  cout << defaultfloat << endl;
+}
+
+// Our search pondering while an opponent thinks for a fixed time per move
+void pondering_reuse() {
+  const int simulation_limit = 5000;
+  const double opponent_time_s = 0.05;
+  multithreading::Pool pool(1);
+  Mcts<Environment,UctSelect,Policy,Backup> algorithm(
+      UctSelect(0.5), Policy(make_rng(1)), Backup());
+  Mcts<Environment,UctSelect,Policy,Backup> opponent(
+      UctSelect(0.5), Policy(make_rng(2)), Backup());
+  Environment env;
+  int moves = 0;
+  while (!env.is_terminal()) {
+    env.step(algorithm.search(env, nullptr, -1, simulation_limit));
+    ++moves;
+    if (env.is_terminal())
+      break;
+    algorithm.ponder(env, pool);
+    env.step(opponent.search(env, nullptr, opponent_time_s));
+    opponent.reroot(env);
+    algorithm.stop_pondering(env);
+  }
+  const auto& stats = algorithm.get_statistics();
+  cout << "Pondering (ultimate_tictactoe, " << simulation_limit << " simulations per move, "
+       << "opponent thinks " << opponent_time_s << "s)\n"
+       << fixed << setprecision(0)
+       << "moves: " << moves << '\n'
+       << "pondering simulations per move: " << double(stats.pondering_simulations)/moves << '\n'
+       << "reused per move: " << double(stats.reused_simulations)/moves << '\n'
+       << "searched simulations per move: " << double(stats.number_of_simulations)/moves << '\n'
+       << setprecision(1)
+       << "search budget saved: "
+       << 100.0*(1 - double(stats.number_of_simulations)/(moves*simulation_limit)) << "%\n"
+       << defaultfloat << endl;
+}
+
+// Blocking search against search_async with progress callbacks, and the
+// delay between cancel() and the handle returning the action
+void async_search() {
+  using namespace chrono;
+  const double budget_s = 1.0;
+  const int callback_interval = 1000;
+  multithreading::Pool pool(1);
+  Environment env;
+  Mcts<Environment,UctSelect,Policy,Backup> blocking(
+      UctSelect(0.5), Policy(make_rng(1)), Backup());
+  blocking.search(env, nullptr, budget_s);
+  double blocking_rate = 1/blocking.get_statistics().time_per_simulation_last;
+  Mcts<Environment,UctSelect,Policy,Backup> algorithm(
+      UctSelect(0.5), Policy(make_rng(1)), Backup());
+  int callbacks = 0;
+  auto handle = algorithm.search_async(env, pool, budget_s, -1, callback_interval,
+      [&callbacks](const SearchProgress<Environment>&) { ++callbacks; });
+  handle.get();
+  double async_rate = 1/algorithm.get_statistics().time_per_simulation_last;
+  algorithm.reset();
+  auto cancelled = algorithm.search_async(env, pool);
+  this_thread::sleep_for(milliseconds(100));
+  auto progress = cancelled.progress();
+  auto cancel_time = steady_clock::now();
+  cancelled.cancel();
+  cancelled.get();
+  duration<double> cancel_latency = steady_clock::now() - cancel_time;
+  cout << "Asynchronous search (ultimate_tictactoe, " << budget_s << "s, "
+       << "callback every " << callback_interval << " simulations)\n"
+       << fixed << setprecision(0)
+       << "blocking sims/s: " << blocking_rate << '\n'
+       << "async sims/s: " << async_rate << " (" << callbacks << " callbacks)\n"
+       << "progress after 100ms: " << progress.number_of_simulations << " simulations, "
+       << progress.root_visits << " root visits\n"
+       << setprecision(1)
+       << "cancel latency: " << cancel_latency.count()*1e6 << "us\n"
+       << defaultfloat << endl;
+}
+
+// Self-play game where both players search within a game clock
+void time_management() {
+  const double clock_s = 5.0;
+  Mcts<Environment,UctSelect,Policy,Backup> player_0(
+      UctSelect(0.5), Policy(make_rng(1)), Backup());
+  Mcts<Environment,UctSelect,Policy,Backup> player_1(
+      UctSelect(0.5), Policy(make_rng(2)), Backup());
+  vector<MctsBase<Environment>*> players{&player_0, &player_1};
+  vector<TimeManager> clocks(2, TimeManager(clock_s));
+  Environment env;
+  while (!env.is_terminal()) {
+    int current = env.get_current_player();
+    env.step(players[current]->managed_search(env, clocks[current]));
+    for (auto* player : players)
+      player->reroot(env);
+  }
+  cout << "Time management (ultimate_tictactoe self-play, " << clock_s << "s per player)\n"
+       << setw(8) << "player" << setw(8) << "moves" << setw(12) << "used (s)"
+       << setw(12) << "saved (s)" << setw(14) << "extended (s)" << setw(12) << "sims/s" << '\n'
+       << fixed << setprecision(2);
+  for (int i = 0; i < 2; ++i) {
+    const auto& stats = players[i]->get_statistics();
+    cout << setw(8) << i << setw(8) << clocks[i].moves_played()
+         << setw(12) << clock_s - clocks[i].remaining()
+         << setw(12) << stats.time_saved << setw(14) << stats.time_extended
+         << setw(12) << setprecision(0) << 1/stats.time_per_simulation
+         << setprecision(2) << '\n';
+  }
+  cout << defaultfloat << endl;
+}
+
+// Where the time of a pass goes, with the whole tree in memory and with a
+// memory that keeps evicting nodes
+void phase_breakdown() {
+  const int number_of_simulations = 20000;
+  cout << "Phases (ultimate_tictactoe, " << number_of_simulations << " simulations)\n";
+  if (!instrumentation_enabled) {
+    cout << "not instrumented: build with -DMCTS_INSTRUMENTATION\n" << endl;
+    return;
+  }
+  cout << setw(10) << "capacity";
+  for (int i = 0; i < PhaseStatistics::number_of_phases; ++i)
+    cout << setw(12) << phase_name(Phase(i));
+  cout << setw(10) << "hit rate" << setw(8) << "depth" << setw(10) << "rollout" << '\n';
+  vector<Statistics> all_stats;
+  for (int capacity : {300000, 1000}) {
+    Mcts<Environment,UctSelect,Policy,Backup> algorithm(
+        UctSelect(0.5), Policy(make_rng(1)), Backup(), capacity);
+    Environment env;
+    algorithm.search(env, nullptr, -1, number_of_simulations);
+    const auto& stats = algorithm.get_statistics();
+    const PhaseStatistics& phases = stats.phases;
+    double total = 0;
+    for (double seconds : phases.seconds)
+      total += seconds;
+    cout << setw(10) << capacity << fixed << setprecision(1);
+    for (double seconds : phases.seconds)
+      cout << setw(11) << 100*seconds/total << '%';
+    cout << setw(9) << 100.0*phases.memory_hits/(phases.memory_hits + phases.memory_misses) << '%'
+         << setw(8) << phases.average_tree_depth()
+         << setw(10) << phases.average_rollout_length() << defaultfloat << '\n';
+    all_stats.push_back(stats);
+  }
+  for (const auto& stats : all_stats) {
+    write_json(cout, stats);
+    cout << '\n';
+  }
+  cout << endl;
+}
+
+/*
+ * Benchmark suite: raw step and rollout rates of every environment and
+ * searches of a fixed number of simulations for every Select, Backup and
+ * UpdateMethod combination. Each row has the rate, the latency percentiles
+ * of a single step (averaged over a game), rollout or search, the peak of
+ * the live bytes and the bytes per node of the tree. The rows can be
+ * written as CSV and compared against a previous CSV to flag regressions.
+ */
+struct SuiteRow {
+  string environment, benchmark;
+  double rate, p50_us, p90_us, p99_us;
+  long peak_bytes;
+  double bytes_per_node;
+};
+
+const int SUITE_GAMES = 200;
+const int SUITE_SEARCHES = 10;
+const int SUITE_SIMULATIONS = 5000;
+const char SUITE_HEADER[] =
+  "environment,benchmark,rate,p50_us,p90_us,p99_us,peak_bytes,bytes_per_node";
+
+double percentile(vector<double> samples, double p) {
+  unsigned k = min<unsigned>(p*samples.size(), samples.size() - 1);
+  nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+SuiteRow make_suite_row(
+    const string& environment,
+    const string& benchmark,
+    const vector<double>& latencies_s,
+    double count,
+    double total_s,
+    long peak_bytes = 0,
+    double bytes_per_node = 0) {
+  return {environment, benchmark, count/total_s,
+          1e6*percentile(latencies_s, 0.5), 1e6*percentile(latencies_s, 0.9),
+          1e6*percentile(latencies_s, 0.99), peak_bytes, bytes_per_node};
+}
+
+// Replays recorded random games so only step() is timed
+template<class Env>
+SuiteRow step_row(const string& environment) {
+  using namespace chrono;
+  Policy policy(make_rng(1));
+  vector<vector<Action<Env>>> games(SUITE_GAMES);
+  for (auto& game : games) {
+    Env env;
+    ActionList<Env> available_actions;
+    while (!env.is_terminal()) {
+      fill_available_actions(env, available_actions);
+      game.push_back(available_actions[policy(env, available_actions)]);
+      env.step(game.back());
+    }
+  }
+  vector<double> latencies;
+  double steps = 0, total = 0;
+  for (const auto& game : games) {
+    Env env;
+    auto start = steady_clock::now();
+    for (const auto& action : game)
+      env.step(action);
+    duration<double> elapsed = steady_clock::now() - start;
+    latencies.push_back(elapsed.count()/game.size());
+    steps += game.size();
+    total += elapsed.count();
+  }
+  return make_suite_row(environment, "step", latencies, steps, total);
+}
+
+template<class Env>
+SuiteRow rollout_row(const string& environment) {
+  using namespace chrono;
+  Policy policy(make_rng(1));
+  vector<double> latencies;
+  double total = 0;
+  Env env;
+  for (int i = 0; i < SUITE_GAMES; ++i) {
+    auto start = steady_clock::now();
+    rollout(env, policy);
+    duration<double> elapsed = steady_clock::now() - start;
+    latencies.push_back(elapsed.count());
+    total += elapsed.count();
+  }
+  return make_suite_row(environment, "rollout", latencies, SUITE_GAMES, total);
+}
+
+// Every search starts from an empty tree; the memory is measured on the first
+template<class Env, class Select, class NodeBackup>
+SuiteRow search_row(
+    const string& environment,
+    const string& benchmark,
+    const Select& select,
+    const NodeBackup& backup) {
+  vector<double> latencies;
+  long peak = 0;
+  double bytes_per_node = 0, total = 0;
+  Env env;
+  for (int i = 0; i < SUITE_SEARCHES; ++i) {
+    long bytes_before = live_bytes;
+    peak_bytes = bytes_before;
+    Mcts<Env,Select,Policy,NodeBackup> algorithm(select, Policy(make_rng(1)), backup);
+    algorithm.search(env, nullptr, -1, SUITE_SIMULATIONS);
+    latencies.push_back(algorithm.get_statistics().elapsed_last_call);
+    total += latencies.back();
+    if (!i) {
+      peak = peak_bytes - bytes_before;
+      bytes_per_node = double(live_bytes - bytes_before)/algorithm.memory_usage();
+    }
+  }
+  return make_suite_row(environment, benchmark, latencies,
+      double(SUITE_SIMULATIONS)*SUITE_SEARCHES, total, peak, bytes_per_node);
+}
+
+template<class Env, template<class,class> class NodeBackup, class Tag>
+void suite_search_rows(
+    vector<SuiteRow>& rows,
+    const string& environment,
+    const string& backup_name) {
+  typedef EpsilonGreedySelect<shared_ptr<pcg32>> EpsilonGreedy;
+  rows.push_back(search_row<Env>(environment, "search/uct/" + backup_name,
+        UctSelect(0.5), NodeBackup<Env,Tag>()));
+  rows.push_back(search_row<Env>(environment, "search/epsilon-greedy/" + backup_name,
+        EpsilonGreedy(make_rng(2)), NodeBackup<Env,Tag>()));
+}
+
+template<class Env, template<class,class> class NodeBackup>
+void suite_backup_rows(
+    vector<SuiteRow>& rows,
+    const string& environment,
+    const string& backup_name) {
+  suite_search_rows<Env,NodeBackup,SampleAverage>(rows, environment, backup_name + "/sample");
+  suite_search_rows<Env,NodeBackup,RunningAverage>(rows, environment, backup_name + "/running");
+  suite_search_rows<Env,NodeBackup,ExponentialAverage>(
+      rows, environment, backup_name + "/exponential");
+}
+
+template<class Env>
+void suite_environment_rows(vector<SuiteRow>& rows, const string& environment) {
+  rows.push_back(step_row<Env>(environment));
+  rows.push_back(rollout_row<Env>(environment));
+  suite_backup_rows<Env,StandardBackup>(rows, environment, "standard");
+  suite_backup_rows<Env,SarsaBackup>(rows, environment, "sarsa");
+  suite_backup_rows<Env,QlearnBackup>(rows, environment, "qlearn");
+}
+
+void write_suite_csv(ostream& out, const vector<SuiteRow>& rows) {
+  out << SUITE_HEADER << '\n' << setprecision(9);
+  for (const auto& row : rows) {
+    out << row.environment << ',' << row.benchmark << ',' << row.rate << ','
+        << row.p50_us << ',' << row.p90_us << ',' << row.p99_us << ','
+        << row.peak_bytes << ',' << row.bytes_per_node << '\n';
+  }
+}
+
+// Rates of a CSV written by write_suite_csv, by environment and benchmark
+map<pair<string,string>,double> read_suite_rates(istream& in) {
+  map<pair<string,string>,double> rates;
+  string line;
+  getline(in, line);
+  if (line != SUITE_HEADER)
+    throw runtime_error("unexpected baseline header: " + line);
+  while (getline(in, line)) {
+    istringstream fields(line);
+    string environment, benchmark, rate;
+    getline(fields, environment, ',');
+    getline(fields, benchmark, ',');
+    getline(fields, rate, ',');
+    rates[{environment, benchmark}] = stod(rate);
+  }
+  return rates;
+}
+
+/*
+ * throughput.x suite [--out results.csv] [--baseline baseline.csv]
+ *                    [--tolerance 0.1]
+ * Fails (returns 1) when a rate drops below (1 - tolerance) times the rate
+ * of the same row in the baseline.
+ */
+int benchmark_suite(const vector<string>& arguments) {
+  string out_path, baseline_path;
+  double tolerance = 0.1;
+  for (unsigned i = 0; i + 1 < arguments.size(); i += 2) {
+    if (arguments[i] == "--out")
+      out_path = arguments[i+1];
+    else if (arguments[i] == "--baseline")
+      baseline_path = arguments[i+1];
+    else if (arguments[i] == "--tolerance")
+      tolerance = stod(arguments[i+1]);
+    else
+      throw invalid_argument("unknown suite option: " + arguments[i]);
+  }
+  if (arguments.size() % 2)
+    throw invalid_argument("missing value of suite option: " + arguments.back());
+  map<pair<string,string>,double> baseline;
+  if (!baseline_path.empty()) {
+    ifstream in(baseline_path);
+    if (!in)
+      throw runtime_error("cannot open baseline: " + baseline_path);
+    baseline = read_suite_rates(in);
+  }
+  vector<SuiteRow> rows;
+  suite_environment_rows<tictactoe::Environment>(rows, "tictactoe");
+  suite_environment_rows<ultimate_tictactoe::Environment>(rows, "ultimate_tictactoe");
+  suite_environment_rows<bidding_game::Environment>(rows, "bidding_game");
+  int regressions = 0;
+  cout << "Benchmark suite (" << SUITE_SIMULATIONS << " simulations per search)\n"
+       << left << setw(20) << "environment" << setw(44) << "benchmark" << right
+       << setw(14) << "rate (1/s)" << setw(12) << "p50 (us)" << setw(12) << "p99 (us)"
+       << setw(12) << "peak (KB)" << setw(12) << "bytes/node";
+  if (!baseline.empty())
+    cout << setw(12) << "vs baseline";
+  cout << '\n' << fixed;
+  for (const auto& row : rows) {
+    cout << left << setw(20) << row.environment << setw(44) << row.benchmark << right
+         << setprecision(0) << setw(14) << row.rate << setprecision(3)
+         << setw(12) << row.p50_us << setw(12) << row.p99_us << setprecision(1)
+         << setw(12) << row.peak_bytes/1024.0 << setw(12) << row.bytes_per_node;
+    auto it = baseline.find({row.environment, row.benchmark});
+    if (it != baseline.end()) {
+      double change = row.rate/it->second - 1;
+      cout << setw(11) << 100*change << '%';
+      if (change < -tolerance) {
+        cout << "  REGRESSION";
+        ++regressions;
+      }
+    }
+    cout << '\n';
+  }
+  cout << defaultfloat << setprecision(6);
+  if (!baseline.empty())
+    cout << regressions << " regressions (tolerance " << 100*tolerance << "%)\n";
+  cout << endl;
+  if (!out_path.empty()) {
+    ofstream out(out_path);
+    write_suite_csv(out, rows);
+  }
+  return regressions? 1 : 0;
+}
+
+// Jobs per second and add_job latency of the pool, with every job submitted
+// from outside the pool and with jobs that submit the rest from the workers
+void pool_scheduling() {
+  using namespace chrono;
+  const int number_of_jobs = 200000;
+  const int fanout = 100;
+  cout << "Pool scheduling (" << number_of_jobs << " jobs, nested fan-out " << fanout << ")\n"
+       << setw(8) << "workers" << setw(14) << "external/s" << setw(14) << "p50 add (ns)"
+       << setw(14) << "p99 add (ns)" << setw(14) << "nested/s" << '\n'
+       << fixed << setprecision(0);
+  for (unsigned n : thread_counts()) {
+    multithreading::Pool pool(n);
+    atomic<long> counter(0);
+    auto job = [&counter] { counter.fetch_add(1, memory_order_relaxed); };
+    vector<double> latencies;
+    latencies.reserve(number_of_jobs);
+    auto start = steady_clock::now();
+    for (int i = 0; i < number_of_jobs; ++i) {
+      auto submit = steady_clock::now();
+      pool.add_job(job);
+      latencies.push_back(duration<double>(steady_clock::now() - submit).count());
+    }
+    pool.wait();
+    duration<double> external = steady_clock::now() - start;
+    start = steady_clock::now();
+    for (int i = 0; i < number_of_jobs/fanout; ++i) {
+      pool.add_job([&pool, &job] {
+        for (int j = 1; j < fanout; ++j)
+          pool.add_job(job);
+        job();
+      });
+    }
+    pool.wait();
+    duration<double> nested = steady_clock::now() - start;
+    cout << setw(8) << n << setw(14) << number_of_jobs/external.count()
+         << setw(14) << 1e9*percentile(latencies, 0.5)
+         << setw(14) << 1e9*percentile(latencies, 0.99)
+         << setw(14) << number_of_jobs/nested.count() << '\n';
+  }
+  cout << defaultfloat << endl;
+}
+
+// Size, write and open times and lookups of a snapshot of a long analysis,
+// and short searches started cold and warm from it
+void snapshot_warm_start() {
+  using namespace chrono;
+  typedef Mcts<Environment,UctSelect,Policy,Backup> Algorithm;
+  const int analysis_simulations = 200000;
+  const int short_simulations = 2000;
+  const int number_of_searches = 20;
+  const string path = "throughput_snapshot.bin";
+  Environment env;
+  Algorithm analysis(UctSelect(0.5), Policy(make_rng(1)), Backup());
+  Action<Environment> analysed = analysis.search(env, nullptr, -1, analysis_simulations);
+  auto start = steady_clock::now();
+  analysis.save_snapshot(path);
+  duration<double> write_time = steady_clock::now() - start;
+  start = steady_clock::now();
+  auto snapshot = make_shared<const Snapshot<Environment>>(path);
+  duration<double> open_time = steady_clock::now() - start;
+  auto probes = random_states(100000, 2);
+  long found = 0;
+  start = steady_clock::now();
+  for (const auto& probe : probes)
+    found += snapshot->find(probe) != nullptr;
+  duration<double> lookup_time = steady_clock::now() - start;
+  int agreement[2] = {0, 0};
+  for (int i = 0; i < number_of_searches; ++i) {
+    for (bool warm : {false, true}) {
+      Algorithm algorithm(UctSelect(0.5), Policy(make_rng(10 + i)), Backup());
+      if (warm)
+        algorithm.set_warm_start(snapshot);
+      agreement[warm] += algorithm.search(env, nullptr, -1, short_simulations) == analysed;
+    }
+  }
+  remove(path.c_str());
+  cout << "Snapshot (ultimate_tictactoe, analysis of " << analysis_simulations << " simulations)\n"
+       << "nodes: " << snapshot->size() << ", bytes: " << snapshot->bytes()
+       << " (" << double(snapshot->bytes())/snapshot->size() << " per node)\n"
+       << fixed << setprecision(1)
+       << "write: " << write_time.count()*1e3 << "ms, open: " << open_time.count()*1e6 << "us\n"
+       << "lookup: " << lookup_time.count()*1e9/probes.size() << "ns ("
+       << 100.0*found/probes.size() << "% hits)\n"
+       << setprecision(0)
+       << "searches of " << short_simulations << " simulations agreeing with the analysis: "
+       << "cold " << agreement[0] << '/' << number_of_searches
+       << ", warm " << agreement[1] << '/' << number_of_searches << '\n'
+       << defaultfloat << endl;
+}
+
+/*
+ * UCT against RAVE, as the speed of the search and as strength, both with
+ * the same simulations per move and with the same time per move (the cost
+ * of the AMAF updates included)
+ */
+void rave_strength() {
+  typedef RaveBackup<Environment,SampleAverage> RaveBackupType;
+  const int simulations = 2000;
+  const double move_time_s = 0.02;
+  const int game_pairs = 20;
+  auto uct = [] {
+    auto rng = make_shared<pcg32>();
+    rng->random_seed();
+    return create_algorithm<Environment>(UctSelect(0.5), Policy(rng), Backup());
+  };
+  auto rave = [] {
+    auto rng = make_shared<pcg32>();
+    rng->random_seed();
+    return create_algorithm<Environment>(RaveSelect(0.2), Policy(rng), RaveBackupType());
+  };
+  Mcts<Environment,UctSelect,Policy,Backup> uct_search(UctSelect(0.5), Policy(make_rng(1)), Backup());
+  Mcts<Environment,RaveSelect,Policy,RaveBackupType> rave_search(
+      RaveSelect(0.2), Policy(make_rng(1)), RaveBackupType());
+  cout << "RAVE (ultimate_tictactoe, " << game_pairs << " game pairs per budget)\n"
+       << fixed << setprecision(0)
+       << "uct sims/s: " << simulations_per_second(uct_search)
+       << ", rave sims/s: " << simulations_per_second(rave_search) << '\n'
+       << setprecision(1);
+  multithreading::Pool pool;
+  for (bool fixed_time : {false, true}) {
+    TournamentOptions options;
+    options.move_time_s = fixed_time? move_time_s : -1;
+    options.move_simulations = fixed_time? -1 : simulations;
+    options.min_game_pairs = options.max_game_pairs = game_pairs;
+    // no early decision: the score over all the games is the measurement
+    options.sprt.alpha = options.sprt.beta = 1e-9;
+    Tournament<Environment> tournament({{"rave(0.2)", rave}, {"uct(0.5)", uct}}, options);
+    auto pairing = tournament.run(pool).front();
+    EloEstimate estimate = estimate_elo(pairing.result);
+    if (fixed_time)
+      cout << move_time_s*1e3 << "ms per move: ";
+    else
+      cout << simulations << " simulations per move: ";
+    cout << "rave " << pairing.result << " (score " << pairing.result.score()
+         << "), elo " << estimate.elo << " [" << estimate.lower << ", " << estimate.upper << "]\n";
+  }
+  cout << defaultfloat << endl;
+}
+
+// bidding_game without its action ordering, so widening takes the bids in
+// increasing order
+struct UnorderedBidding : bidding_game::Environment {
+  void order_actions(ActionBuffer&) const = delete;
+};
+
+// UCT that counts the actions it scans
+struct CountingSelect {
+  UctSelect select;
+  shared_ptr<long> selections, scanned;
+
+  template<class Node>
+  int operator()(const Node& node) const {
+    ++*selections;
+    *scanned += node.action_vector.size();
+    return select(node);
+  }
+};
+
+template<class BiddingEnvironment, class NodeBackup>
+void widening_row(const string& name, const NodeBackup& backup) {
+  const int number_of_simulations = 20000;
+  CountingSelect select{UctSelect(0.5), make_shared<long>(0), make_shared<long>(0)};
+  Mcts<BiddingEnvironment,CountingSelect,Policy,NodeBackup> algorithm(
+      select, Policy(make_rng(1)), backup);
+  long bytes_before = live_bytes;
+  BiddingEnvironment env;
+  algorithm.search(env, nullptr, -1, number_of_simulations);
+  double bytes = live_bytes - bytes_before;
+  const auto& stats = algorithm.get_statistics();
+  cout << setw(16) << name
+       << setw(12) << stats.number_of_simulations_last/stats.elapsed_last_call
+       << setw(12) << double(*select.scanned)/ *select.selections
+       << setw(12) << bytes/algorithm.memory_usage() << '\n';
+}
+
+// Score of the widening player against full nodes, at fixed simulations
+template<class BiddingEnvironment>
+void widening_strength(const string& name, int simulations, int game_pairs) {
+  typedef StandardBackup<BiddingEnvironment,SampleAverage> BiddingBackup;
+  auto full = [] {
+    auto rng = make_shared<pcg32>();
+    rng->random_seed();
+    return create_algorithm<BiddingEnvironment>(UctSelect(0.5), Policy(rng), BiddingBackup());
+  };
+  auto widening = [] {
+    auto rng = make_shared<pcg32>();
+    rng->random_seed();
+    return create_algorithm<BiddingEnvironment>(
+        UctSelect(0.5), Policy(rng), WideningNodes<BiddingBackup>());
+  };
+  TournamentOptions options;
+  options.move_time_s = -1;
+  options.move_simulations = simulations;
+  options.min_game_pairs = options.max_game_pairs = game_pairs;
+  // no early decision: the score over all the games is the measurement
+  options.sprt.alpha = options.sprt.beta = 1e-9;
+  Tournament<BiddingEnvironment> tournament({{"widening", widening}, {"full", full}}, options);
+  multithreading::Pool pool;
+  auto pairing = tournament.run(pool).front();
+  EloEstimate estimate = estimate_elo(pairing.result);
+  cout << name << " vs full nodes: " << pairing.result << " (score " << pairing.result.score()
+       << "), elo " << estimate.elo << " [" << estimate.lower << ", " << estimate.upper << "]\n";
+}
+
+/*
+ * Progressive widening on the wide nodes of bidding_game (a bid for every
+ * unit of budget): speed, actions scanned by every selection and bytes per
+ * node, and strength against full nodes at the same simulations
+ */
+void progressive_widening() {
+  typedef bidding_game::Environment Bidding;
+  const int simulations = 2000;
+  const int game_pairs = 50;
+  cout << "Progressive widening (bidding_game, 20000 simulations)\n"
+       << setw(16) << "nodes" << setw(12) << "sims/s"
+       << setw(12) << "scanned" << setw(12) << "bytes/node" << '\n'
+       << fixed << setprecision(1);
+  widening_row<Bidding>("full", StandardBackup<Bidding,SampleAverage>());
+  widening_row<UnorderedBidding>("widening",
+      WideningNodes<StandardBackup<UnorderedBidding,SampleAverage>>());
+  widening_row<Bidding>("widening+order", WideningNodes<StandardBackup<Bidding,SampleAverage>>());
+  cout << simulations << " simulations per move, " << game_pairs << " game pairs:\n";
+  widening_strength<UnorderedBidding>("widening", simulations, game_pairs);
+  widening_strength<Bidding>("widening+order", simulations, game_pairs);
+  cout << defaultfloat << endl;
+}
+
+void tree_parallel_scaling() {
+  parallel_scaling<TreeParallelMcts>("Tree-parallel", "threads");
+}
+
+void root_parallel_scaling() {
+  parallel_scaling<RootParallelMcts>("Root-parallel", "members");
+}
+
+} // anonymous ns
+
+int main(int argc, char* argv[]) {
+  vector<pair<string,function<void()>>> benchmarks{
+    {"tree-parallel", tree_parallel_scaling},
+    {"root-parallel", root_parallel_scaling},
+    {"leaf-parallel", leaf_parallel_scaling},
+    {"rollouts", batched_rollouts},
+    {"memory", memory_maps},
+    {"hash", state_hashing},
+    {"nodes", node_storage},
+    {"perft", ultimate_perft},
+    {"select", selection_kernels},
+    {"ponder", pondering_reuse},
+    {"async", async_search},
+    {"time", time_management},
+    {"phases", phase_breakdown},
+    {"pool", pool_scheduling},
+    {"snapshot", snapshot_warm_start},
+    {"random", random_sampling},
+    {"rave", rave_strength},
+    {"widening", progressive_widening},
+  };
+  string selected = argc > 1? argv[1] : "all";
+  if (selected == "suite") {
+    try {
+      return benchmark_suite(vector<string>(argv + 2, argv + argc));
+    }
+    catch (const exception& e) {
+      cerr << e.what() << '\n';
+      return 2;
+    }
+  }
+  bool found = false;
+  for (const auto&[name, benchmark] : benchmarks) {
+    if (selected == "all" || selected == name) {
+      benchmark();
+      found = true;
+    }
+  }
+  if (!found) {
+    cerr << "Usage: " << argv[0] << " [all";
+    for (const auto& benchmark : benchmarks)
+      cerr << '|' << benchmark.first;
+    cerr << "]\n"
+         << "       " << argv[0] << " suite [--out results.csv] [--baseline baseline.csv]"
+         << " [--tolerance 0.1]\n";
+    return 1;
+  }
+}
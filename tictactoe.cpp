@@ -5,7 +5,14 @@
 
 namespace tictactoe {
 
-Environment::Environment() : m_state{0} {
+namespace {
+
+// One key per bit of the board
+constexpr auto CELL_KEYS = mcts::make_zobrist_keys<18>(0x7417ac);
+
+} // anonymous ns
+
+Environment::Environment() : m_state{0, 0} {
 
 }
 
@@ -14,13 +21,16 @@ int Environment::get_turn() const {
 }
 
 std::vector<Action> Environment::get_available_actions() const {
-  std::vector<Action> available_actions;
-  available_actions.reserve(9);
+  ActionBuffer available_actions;
+  get_available_actions(available_actions);
+  return {available_actions.begin(), available_actions.end()};
+}
+
+void Environment::get_available_actions(ActionBuffer& actions) const {
   for (int i = 0; i < 9; ++i) {
     if (is_free_cell(m_state.board, i))
-      available_actions.push_back({i});
+      actions.push_back({i});
   }
-  return available_actions;
 }
 
 int Environment::get_current_player() const {
@@ -47,12 +57,15 @@ Reward Environment::get_score() const {
 Reward Environment::step(const Action& action, bool check) {
   if (check)
     mcts::check_action(*this, action);
-  make_move(m_state.board, action.cell, get_current_player());
+  int player = get_current_player();
+  make_move(m_state.board, action.cell, player);
+  m_state.key ^= CELL_KEYS[action.cell + 9*player];
   return get_score();
 }
 
 void Environment::reset() {
   m_state.board.reset();
+  m_state.key = 0;
 }
 
 bool operator==(const State& lhs, const State& rhs) {
@@ -105,6 +118,5 @@ std::istream& operator>>(std::istream& in, Action& action) {
 } // tictactoe
 
 size_t std::hash<tictactoe::State>::operator()(const State& state) const {
-  std::hash<tictactoe::Board> hasher;
-  return hasher(state.board);
+  return state.key;
 }
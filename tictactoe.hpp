@@ -2,11 +2,13 @@
 
 #include <array>
 #include <bitset>
+#include <cstdint>
 #include <functional>
 #include <ostream>
 #include <vector>
 
 #include "tictactoe_utils.hpp"
+#include "utils.hpp"
 
 namespace tictactoe {
 
@@ -19,12 +21,18 @@ class Environment {
 
     struct State {
       Board board;
+      // Zobrist key of the board, kept up to date by step()
+      std::uint64_t key;
     };
 
     struct Action {
       int cell;
     };
 
+    static constexpr int max_number_of_actions = 9;
+
+    typedef mcts::StaticVector<Action,max_number_of_actions> ActionBuffer;
+
     Environment();
 
     int get_turn() const;
@@ -33,6 +41,8 @@ class Environment {
 
     std::vector<Action> get_available_actions() const;
 
+    void get_available_actions(ActionBuffer& actions) const;
+
     int get_number_of_players() const { return number_of_players; }
 
     int get_current_player() const;
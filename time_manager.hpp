@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+
+namespace mcts {
+
+/*
+ * Time bounds of a single search. The search may stop before soft_s when
+ * the most visited action is decided, and go on until hard_s while the
+ * visits of the two best actions are within closeness of each other
+ * (second >= closeness*best).
+ */
+struct MoveBudget {
+  double soft_s, hard_s, closeness;
+};
+
+/*
+ * Splits a game clock into per move budgets: the soft budget is the
+ * remaining time divided by the number of moves we still expect to play,
+ * and the hard one extends it by max_extension, without ever taking more
+ * than max_share of what is left on the clock.
+ */
+class TimeManager {
+  public:
+    TimeManager(
+      double total_time_s,
+      int expected_moves = 40,
+      int min_moves_left = 10,
+      double max_extension = 2.5,
+      double max_share = 0.25,
+      double closeness = 0.8
+    ) :
+      m_remaining(total_time_s),
+      m_expected_moves(expected_moves),
+      m_min_moves_left(min_moves_left),
+      m_max_extension(max_extension),
+      m_max_share(max_share),
+      m_closeness(closeness),
+      m_moves_played(0) {}
+
+    MoveBudget allocate() const {
+      int moves_left = std::max(m_expected_moves - m_moves_played, m_min_moves_left);
+      double remaining = std::max(m_remaining, 0.0);
+      double cap = m_max_share*remaining;
+      double soft = std::min(remaining/moves_left, cap);
+      double hard = std::min(soft*m_max_extension, cap);
+      return {soft, hard, m_closeness};
+    }
+
+    void consume(double elapsed_s) {
+      m_remaining -= elapsed_s;
+      ++m_moves_played;
+    }
+
+    double remaining() const {
+      return m_remaining;
+    }
+
+    int moves_played() const {
+      return m_moves_played;
+    }
+
+  private:
+    double m_remaining;
+    int m_expected_moves, m_min_moves_left;
+    double m_max_extension, m_max_share, m_closeness;
+    int m_moves_played;
+};
+
+/*
+ * Visits of the most visited and the second most visited actions of a
+ * node (0 for the second one if there is a single action).
+ */
+template<class Node>
+std::pair<int,int> top_two_visits(const Node& node) {
+  int best = 0, second = 0;
+  for (unsigned i = 0; i < node.action_vector.size(); ++i) {
+    int visits = node.action_vector[i].visits;
+    if (visits > best) {
+      second = best;
+      best = visits;
+    }
+    else if (visits > second)
+      second = visits;
+  }
+  return {best, second};
+}
+
+} // mcts
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mcts.hpp"
+#include "thread_pool.hpp"
+
+namespace mcts {
+
+struct ResultSummary {
+  int wins, ties, loses;
+  ResultSummary& operator+=(const ResultSummary& other) {
+    wins += other.wins;
+    ties += other.ties;
+    loses += other.loses;
+    return *this;
+  }
+  ResultSummary operator+(const ResultSummary& other) const {
+    ResultSummary result = *this;
+    result += other;
+    return result;
+  }
+  ResultSummary reverse() const {
+    ResultSummary reversed;
+    reversed.wins = loses;
+    reversed.ties = ties;
+    reversed.loses = wins;
+    return reversed;
+  }
+  int games() const {
+    return wins + ties + loses;
+  }
+  double score() const {
+    return games()? (wins + 0.5*ties)/games() : 0.5;
+  }
+  // Variance of the points of a single game
+  double variance() const {
+    if (!games())
+      return 0;
+    double s = score();
+    return (wins*(1 - s)*(1 - s) + ties*(0.5 - s)*(0.5 - s) + loses*s*s)/games();
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const ResultSummary& result) {
+  return out << result.wins << '/' << result.ties << '/' << result.loses;
+}
+
+// Logistic Elo difference that corresponds to an expected score and back
+inline double elo_difference(double score) {
+  score = std::clamp(score, 1e-6, 1 - 1e-6);
+  return -400*std::log10(1/score - 1);
+}
+
+inline double expected_score(double elo) {
+  return 1/(1 + std::pow(10, -elo/400));
+}
+
+struct EloEstimate {
+  double elo, lower, upper;
+};
+
+// Elo difference with its 95% confidence interval (normal approximation)
+inline EloEstimate estimate_elo(const ResultSummary& result) {
+  double s = result.score();
+  double margin = result.games()? 1.96*std::sqrt(result.variance()/result.games()) : 0.5;
+  return {elo_difference(s), elo_difference(s - margin), elo_difference(s + margin)};
+}
+
+/*
+ * Sequential probability ratio test of H0: elo = elo0 against H1: elo =
+ * elo1, with the generalized SPRT approximation of the log likelihood ratio
+ * of a trinomial (win/tie/loss) sample. The defaults decide which of the two
+ * players is stronger, treating differences below 15 Elo as indifferent.
+ */
+struct Sprt {
+  enum class Decision { undecided, accept_h0, accept_h1 };
+
+  double elo0 = -15, elo1 = 15, alpha = 0.05, beta = 0.05;
+
+  double llr(const ResultSummary& result) const {
+    double variance = result.variance();
+    if (!result.games() || variance <= 0)
+      return 0;
+    double s0 = expected_score(elo0), s1 = expected_score(elo1);
+    return result.games()*(s1 - s0)*(2*result.score() - s0 - s1)/(2*variance);
+  }
+
+  Decision decide(const ResultSummary& result) const {
+    double value = llr(result);
+    if (value >= std::log((1 - beta)/alpha))
+      return Decision::accept_h1;
+    if (value <= std::log(beta/(1 - alpha)))
+      return Decision::accept_h0;
+    return Decision::undecided;
+  }
+};
+
+struct TournamentOptions {
+  double move_time_s = 0.1;
+  int move_simulations = -1;
+  int min_game_pairs = 4;
+  int max_game_pairs = 100;
+  Sprt sprt;
+};
+
+/*
+ * Round-robin tournament between search configurations. Every pairing plays
+ * pairs of games (each player moving first in one of them) as jobs of a
+ * pool until the SPRT decides it or max_game_pairs are played. Finished
+ * game pairs are reported to the log as they come in. The players are
+ * created from scratch for every game, from the threads of the pool.
+ */
+template<class Environment>
+class Tournament {
+  public:
+    typedef std::function<std::unique_ptr<MctsBase<Environment>>()> PlayerFactory;
+
+    struct Player {
+      std::string name;
+      PlayerFactory create;
+    };
+
+    struct Pairing {
+      int first, second;
+      ResultSummary result;  // from the point of view of first
+      Sprt::Decision decision;
+      int scheduled;  // game pairs
+    };
+
+    Tournament(std::vector<Player> players, TournamentOptions options = TournamentOptions()) :
+      m_players(std::move(players)),
+      m_options(options) {}
+
+    std::vector<Pairing> run(multithreading::Pool& pool, std::ostream* log = nullptr) {
+      std::vector<Pairing> pairings;
+      for (int i = 0; i < int(m_players.size()); ++i) {
+        for (int j = i + 1; j < int(m_players.size()); ++j)
+          pairings.push_back({i, j, {0, 0, 0}, Sprt::Decision::undecided, 0});
+      }
+      std::mutex mtx;
+      std::condition_variable finished_cv;
+      std::queue<std::pair<int,ResultSummary>> finished;
+      int in_flight = 0;
+      unsigned next = 0;
+      while (true) {
+        // keep every worker busy with the undecided pairings, in turns
+        while (in_flight < int(pool.number_of_workers())) {
+          int index = next_pairing(pairings, next);
+          if (index < 0)
+            break;
+          Pairing& pairing = pairings[index];
+          ++pairing.scheduled;
+          ++in_flight;
+          pool.add_job([this, index, &pairing, &mtx, &finished_cv, &finished] {
+            ResultSummary result = play(pairing.first, pairing.second) +
+                                   play(pairing.second, pairing.first).reverse();
+            // notified under the lock: run() may return as soon as it sees the result
+            std::lock_guard<std::mutex> lock(mtx);
+            finished.push({index, result});
+            finished_cv.notify_one();
+          });
+        }
+        if (!in_flight)
+          break;
+        std::unique_lock<std::mutex> lock(mtx);
+        finished_cv.wait(lock, [&finished] { return !finished.empty(); });
+        auto[index, result] = finished.front();
+        finished.pop();
+        lock.unlock();
+        --in_flight;
+        Pairing& pairing = pairings[index];
+        pairing.result += result;
+        if (pairing.decision == Sprt::Decision::undecided &&
+            pairing.result.games() >= 2*m_options.min_game_pairs)
+          pairing.decision = m_options.sprt.decide(pairing.result);
+        if (log)
+          log_pairing(*log, pairing);
+      }
+      return pairings;
+    }
+
+    const std::vector<Player>& players() const {
+      return m_players;
+    }
+
+    void log_pairing(std::ostream& log, const Pairing& pairing) const {
+      EloEstimate estimate = estimate_elo(pairing.result);
+      log << m_players[pairing.first].name << " vs " << m_players[pairing.second].name
+          << ": " << pairing.result << ", elo " << estimate.elo
+          << " [" << estimate.lower << ", " << estimate.upper << "], llr "
+          << m_options.sprt.llr(pairing.result);
+      if (pairing.decision == Sprt::Decision::accept_h1)
+        log << " (H1 accepted)";
+      else if (pairing.decision == Sprt::Decision::accept_h0)
+        log << " (H0 accepted)";
+      log << std::endl;
+    }
+
+  private:
+    // Index of the next pairing that needs games after next (-1 if none)
+    int next_pairing(const std::vector<Pairing>& pairings, unsigned& next) const {
+      for (unsigned tried = 0; tried < pairings.size(); ++tried) {
+        int index = next++ % pairings.size();
+        const Pairing& pairing = pairings[index];
+        if (pairing.decision == Sprt::Decision::undecided &&
+            pairing.scheduled < m_options.max_game_pairs)
+          return index;
+      }
+      return -1;
+    }
+
+    // Result of a game where players[first] makes the first move
+    ResultSummary play(int first, int second) const {
+      std::unique_ptr<MctsBase<Environment>> seats[] = {
+        m_players[first].create(), m_players[second].create()
+      };
+      Environment env;
+      while (!env.is_terminal()) {
+        auto& player = *seats[env.get_current_player()];
+        env.step(player.search(env, nullptr, m_options.move_time_s, m_options.move_simulations));
+      }
+      auto score = env.get_score();
+      return {score[0] > score[1], score[0] == score[1], score[0] < score[1]};
+    }
+
+    std::vector<Player> m_players;
+    TournamentOptions m_options;
+};
+
+} // mcts
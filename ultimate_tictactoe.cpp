@@ -8,6 +8,24 @@ namespace ultimate_tictactoe {
 
 namespace {
 
+constexpr unsigned FULL_MASK = 0x1FF;
+
+// One key per bit of every subboard and one per value of active_subboard + 1
+constexpr auto CELL_KEYS = mcts::make_zobrist_keys<9*18>(0x0171ac);
+constexpr auto ACTIVE_SUBBOARD_KEYS = mcts::make_zobrist_keys<10>(0xac71fe);
+
+inline unsigned x_cells(Subboard subboard) {
+  return subboard & FULL_MASK;
+}
+
+inline unsigned o_cells(Subboard subboard) {
+  return subboard >> 9;
+}
+
+inline unsigned free_cells(Subboard subboard) {
+  return ~(x_cells(subboard) | o_cells(subboard)) & FULL_MASK;
+}
+
 std::pair<int,int> to_subboard_cell(int i, int j) {
   int subboard = i - i%3 + j/3;
   int cell = (i%3)*3 + j%3;
@@ -22,11 +40,12 @@ std::pair<int,int> to_row_col(int subboard, int cell) {
 
 char get_char_representation(const State& state, int i, int j) {
   auto[subboard, cell] = to_subboard_cell(i, j);
-  return tictactoe::get_char_representation(state.subboards[subboard], cell);
+  return tictactoe::get_char_representation(
+      tictactoe::Board(state.subboards[subboard]), cell);
 }
 
 char get_subboard_status_char(const State& state, int subboard) {
-  switch (tictactoe::calculate_result(state.subboards[subboard])) {
+  switch (tictactoe::calculate_result(tictactoe::Board(state.subboards[subboard]))) {
     case Result::tie:
       return 'T';
     case Result::o_wins:
@@ -41,12 +60,10 @@ char get_subboard_status_char(const State& state, int subboard) {
 void get_available_actions_helper(
     const State& state,
     int subboard,
-    std::vector<Action>& available_actions
+    Environment::ActionBuffer& available_actions
 ) {
-  for (int cell = 0; cell < 9; ++cell) {
-    if (tictactoe::is_free_cell(state.subboards[subboard], cell))
-      available_actions.push_back({subboard, cell});
-  }
+  for (unsigned mask = free_cells(state.subboards[subboard]); mask; mask &= mask-1)
+    available_actions.push_back({subboard, __builtin_ctz(mask)});
 }
 
 } // anonymous ns
@@ -56,18 +73,18 @@ Environment::Environment() {
 }
 
 std::vector<Action> Environment::get_available_actions() const {
-  std::vector<Action> available_actions;
+  ActionBuffer available_actions;
+  get_available_actions(available_actions);
+  return {available_actions.begin(), available_actions.end()};
+}
+
+void Environment::get_available_actions(ActionBuffer& actions) const {
   if (m_state.active_subboard == -1) {
-    available_actions.reserve(81);
-    for (int subboard = 0; subboard < 9; ++subboard)
-      if (m_playable_subboards[subboard])
-        get_available_actions_helper(m_state, subboard, available_actions);
-  }
-  else {
-    available_actions.reserve(9);
-    get_available_actions_helper(m_state, m_state.active_subboard, available_actions);
+    for (unsigned mask = m_playable_subboards; mask; mask &= mask-1)
+      get_available_actions_helper(m_state, __builtin_ctz(mask), actions);
   }
-  return available_actions;
+  else
+    get_available_actions_helper(m_state, m_state.active_subboard, actions);
 }
 
 bool Environment::is_terminal() const {
@@ -77,49 +94,50 @@ bool Environment::is_terminal() const {
 const Reward& Environment::step(const Action& action, bool check) {
   if (check)
     mcts::check_action(*this, action);
-  tictactoe::make_move(m_state.subboards[action.subboard],
-      action.cell, m_current_player);
-  switch (tictactoe::calculate_result(m_state.subboards[action.subboard])) {
-    case Result::tie:
-      m_playable_subboards[action.subboard] = false;
-      update_score();
-      break;
-    case Result::o_wins:
-      m_playable_subboards[action.subboard] = false;
-      m_o_winned_subboards[action.subboard] = true;
-      update_score();
-      break;
-    case Result::x_wins:
-      m_playable_subboards[action.subboard] = false;
-      m_x_winned_subboards[action.subboard] = true;
-      update_score();
-    default:
-      break;
+  Subboard& subboard = m_state.subboards[action.subboard];
+  unsigned subboard_bit = 1U << action.subboard;
+  int offset = 9*m_current_player;
+  subboard |= Subboard(1) << (action.cell + offset);
+  m_state.key ^= CELL_KEYS[18*action.subboard + offset + action.cell];
+  // only the player that has just moved can have completed a line
+  if (tictactoe::LU_TABLE[(subboard >> offset) & FULL_MASK]) {
+    m_playable_subboards &= ~subboard_bit;
+    if (m_current_player)
+      m_o_winned_subboards |= subboard_bit;
+    else
+      m_x_winned_subboards |= subboard_bit;
+    update_score();
+  }
+  else if (!free_cells(subboard)) {
+    m_playable_subboards &= ~subboard_bit;
+    update_score();
   }
   ++m_turn;
   m_current_player = !m_current_player;
-  m_state.active_subboard = m_playable_subboards[action.cell]? action.cell : -1;
+  m_state.key ^= ACTIVE_SUBBOARD_KEYS[m_state.active_subboard + 1];
+  m_state.active_subboard = (m_playable_subboards >> action.cell) & 1? action.cell : -1;
+  m_state.key ^= ACTIVE_SUBBOARD_KEYS[m_state.active_subboard + 1];
   return m_score;
 }
 
 void Environment::reset() {
-  for (auto& subboard : m_state.subboards)
-    subboard.reset();
+  m_state.subboards.fill(0);
   m_state.active_subboard = -1;
-  m_x_winned_subboards.reset();
-  m_o_winned_subboards.reset();
-  m_playable_subboards.set();
+  m_state.key = ACTIVE_SUBBOARD_KEYS[0];
+  m_x_winned_subboards = 0;
+  m_o_winned_subboards = 0;
+  m_playable_subboards = FULL_MASK;
   m_score = Reward();
   m_turn = m_current_player = 0;
 }
 
 void Environment::update_score() {
   using tictactoe::LU_TABLE;
-  bool x_ttt = LU_TABLE[m_x_winned_subboards.to_ulong()];
-  bool o_ttt = LU_TABLE[m_o_winned_subboards.to_ulong()];
-  bool more_plays = m_playable_subboards.any();
-  int x_win_count = m_x_winned_subboards.count();
-  int o_win_count = m_o_winned_subboards.count();
+  bool x_ttt = LU_TABLE[m_x_winned_subboards];
+  bool o_ttt = LU_TABLE[m_o_winned_subboards];
+  bool more_plays = m_playable_subboards;
+  int x_win_count = __builtin_popcount(m_x_winned_subboards);
+  int o_win_count = __builtin_popcount(m_o_winned_subboards);
   bool x_wins = x_ttt || (!more_plays && !o_ttt && x_win_count>o_win_count);
   bool o_wins = o_ttt || (!more_plays && !x_ttt && o_win_count>x_win_count);
   bool tie = !x_wins && !o_wins && !more_plays;
@@ -179,10 +197,6 @@ std::istream& operator>>(std::istream& in, Action& action) {
 } // ultimate_tictactoe
 
 std::size_t std::hash<ultimate_tictactoe::State>::operator()(const State& state) const {
-  std::size_t seed = 0;
-  mcts::hash_combine(seed, state.active_subboard);
-  for (auto subboard : state.subboards)
-    mcts::hash_combine(seed, subboard);
-  return seed;
+  return state.key;
 }
 
@@ -2,29 +2,44 @@
 
 #include <array>
 #include <bitset>
+#include <cstdint>
 #include <functional>
 #include <ostream>
 #include <vector>
 
 #include "tictactoe_utils.hpp"
+#include "utils.hpp"
 
 namespace ultimate_tictactoe {
 
 typedef std::bitset<9> ActiveMask;
 
+/*
+ * Every subboard is packed in the low 18 bits of an integer, with the same
+ * layout as tictactoe::Board: bits 0-8 hold the x cells and bits 9-17 the
+ * o cells.
+ */
+typedef std::uint32_t Subboard;
+
 class Environment {
   public:
     static constexpr int number_of_players = 2;
 
     struct State {
-      std::array<tictactoe::Board,9> subboards;
+      std::array<Subboard,9> subboards;
       int active_subboard;
+      // Zobrist key of the cells and the active subboard, kept up to date by step()
+      std::uint64_t key;
     };
 
     struct Action {
       int subboard, cell;
     };
 
+    static constexpr int max_number_of_actions = 81;
+
+    typedef mcts::StaticVector<Action,max_number_of_actions> ActionBuffer;
+
     typedef std::array<double,number_of_players> Reward;
 
     Environment();
@@ -35,6 +50,8 @@ class Environment {
 
     std::vector<Action> get_available_actions() const;
 
+    void get_available_actions(ActionBuffer& actions) const;
+
     int get_number_of_players() const { return number_of_players; }
 
     int get_current_player() const { return m_current_player; }
@@ -53,9 +70,10 @@ class Environment {
 
     Reward m_score;
     State m_state;
-    std::bitset<9> m_playable_subboards;
-    std::bitset<9> m_x_winned_subboards;
-    std::bitset<9> m_o_winned_subboards;
+    // 9-bit masks with one bit per subboard
+    unsigned m_playable_subboards;
+    unsigned m_x_winned_subboards;
+    unsigned m_o_winned_subboards;
     int m_turn;
     int m_current_player;
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <sstream>
@@ -20,6 +21,65 @@ void check_action(const Environment& env, const typename Environment::Action& ac
   }
 }
 
+/*
+ * Vector with a fixed capacity that lives in place (e.g. on the stack), so
+ * filling it never allocates. Meant for trivial types such as actions.
+ */
+template<class T, std::size_t N>
+class StaticVector {
+  public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    StaticVector() : m_size(0) {}
+
+    void push_back(const T& value) { m_data[m_size++] = value; }
+
+    void clear() { m_size = 0; }
+
+    std::size_t size() const { return m_size; }
+
+    static constexpr std::size_t capacity() { return N; }
+
+    bool empty() const { return !m_size; }
+
+    T& operator[](std::size_t i) { return m_data[i]; }
+
+    const T& operator[](std::size_t i) const { return m_data[i]; }
+
+    iterator begin() { return m_data.data(); }
+
+    iterator end() { return m_data.data() + m_size; }
+
+    const_iterator begin() const { return m_data.data(); }
+
+    const_iterator end() const { return m_data.data() + m_size; }
+
+  private:
+    std::array<T,N> m_data;
+    std::size_t m_size;
+};
+
+/*
+ * Pseudo random keys for Zobrist hashing, generated at compile time with
+ * splitmix64. The key of a state is the xor of the keys of its features, so
+ * an environment can keep it up to date in step() by xoring out the
+ * features that disappear and xoring in the new ones.
+ */
+template<std::size_t N>
+constexpr std::array<std::uint64_t,N> make_zobrist_keys(std::uint64_t seed) {
+  std::array<std::uint64_t,N> keys{};
+  for (std::size_t i = 0; i < N; ++i) {
+    seed += 0x9e3779b97f4a7c15ULL;
+    std::uint64_t z = seed;
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+    keys[i] = z ^ (z >> 31);
+  }
+  return keys;
+}
+
 template <typename T>
 inline void hash_combine(std::size_t& seed, const T& val) {
   static_assert(sizeof(std::size_t) == 4 || sizeof(std::size_t) == 8);